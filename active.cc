@@ -0,0 +1,100 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  void GraphBase::advanceActive()
+  {
+    traceExchangeBegin("active");
+    if (rec_req.size()!=nprocs()) updateRequests();
+    bool dense=changedObjects.size() > denseThreshold*size();
+    vector<GraphId> changedGhosts;
+
+#ifdef MPI_SUPPORT
+    if (nprocs()>1)
+      {
+        /*
+           both modes use the same message format, so each processor
+           can choose independently
+        */
+        MPIbuf_array sendbuf(nprocs());
+        traffic.rounds++;
+        if (dense)
+          {
+            traffic.full++;
+            for (unsigned proc=0; proc<nprocs(); proc++)
+              for (auto id: rec_req[proc])
+                sendbuf[proc] << id << objectRef(id);
+          }
+        else
+          for (auto id: changedObjects)
+            {
+              auto sub=subscribers.find(id);
+              if (sub==subscribers.end()) continue; /* not a boundary object */
+              traffic.sparse[id]++;
+              for (auto proc: sub->second)
+                sendbuf[proc] << id << objectRef(id);
+            }
+
+        tag++;
+        unsigned nRecv=0;
+        for (unsigned proc=0; proc<nprocs(); proc++)
+          {
+            if (!rec_req[proc].empty()) sendbuf[proc].isend(proc,tag);
+            if (!requests[proc].empty()) nRecv++;
+          }
+        for (unsigned i=0; i<nRecv; i++)
+          {
+            MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+            haloReceived(b.proc,b.size());
+            while (b.pos()<b.size())
+              {
+                GraphId id;
+                b>>id;
+                b>>objectRef(id);
+                changedGhosts.push_back(id);
+              }
+          }
+        localIndexData.stale=true;
+      }
+#endif
+
+    if (dense)
+      activateAll();
+    else
+      {
+        std::unordered_set<GraphId> scheduled;
+        active.clear();
+        auto schedule=[&](const ObjRef& x) {
+          if (scheduled.insert(x.id()).second)
+            active.push_back(x);
+        };
+        auto scheduleDependants=[&](GraphId id) {
+          auto d=dependants.find(id);
+          if (d!=dependants.end())
+            for (auto& x: d->second)
+              schedule(x);
+        };
+        for (auto id: changedObjects)
+          {
+            schedule(objectRef(id));
+            scheduleDependants(id);
+          }
+        for (auto id: changedGhosts)
+          scheduleDependants(id);
+      }
+    changedObjects.clear();
+    traceExchangeEnd();
+  }
+}
@@ -0,0 +1,340 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/**
+   Distributed graph algorithms operating on any Graph<T>.
+
+   Algorithm state is held in maps keyed by GraphId, rather than in
+   the objects themselves, and exchanged with
+   GraphBase::exchangeValues, so only entries that changed in the
+   previous round cross processor boundaries. Entries for locally
+   hosted objects are authoritative; entries for ghost objects are
+   cached copies.
+
+   Links are treated as undirected, as the partitioner does, so each
+   object's neighbours should be symmetric. Self links are ignored.
+
+   All functions must be called on all processors simultaneously.
+*/
+
+#ifndef GRAPHCODE_ALGORITHMS_H
+#define GRAPHCODE_ALGORITHMS_H
+
+#include "graphcode.h"
+#include <cmath>
+#include <limits>
+
+namespace graphcode
+{
+  namespace detail
+  {
+    /// for each object, the locally hosted objects linking to it, together with the link
+    using Dependants=std::unordered_map<GraphId, vector<std::pair<ObjRef,ObjRef> > >;
+
+    inline Dependants dependants(const GraphBase& g)
+    {
+      Dependants r;
+      for (auto& i: g)
+        for (auto& n: *i)
+          if (n.id()!=i.id())
+            r[n.id()].emplace_back(i,n);
+      return r;
+    }
+
+    /// number of links of \a x, excluding self links
+    inline unsigned degree(const ObjRef& x)
+    {
+      unsigned r=0;
+      for (auto& n: *x)
+        if (n.id()!=x.id()) r++;
+      return r;
+    }
+
+    /// largest h such that at least h elements of \a x are \f$\geq h\f$
+    inline unsigned hIndex(vector<unsigned>& x)
+    {
+      std::sort(x.begin(),x.end(),std::greater<unsigned>());
+      unsigned h=0;
+      while (h<x.size() && x[h]>=h+1) h++;
+      return h;
+    }
+
+    /// number of elements common to two sorted ranges
+    template <class I>
+    unsigned long intersectionSize(I b1, I e1, I b2, I e2)
+    {
+      unsigned long r=0;
+      while (b1!=e1 && b2!=e2)
+        if (*b1<*b2) ++b1;
+        else if (*b2<*b1) ++b2;
+        else {++r; ++b1; ++b2;}
+      return r;
+    }
+  }
+
+  /**
+     breadth first search from \a source. Returns the number of hops
+     from \a source to each object reached. Unreached objects have no
+     entry.
+  */
+  template <class T>
+  std::unordered_map<GraphId,unsigned> bfsLevels(Graph<T>& g, GraphId source)
+  {
+    std::unordered_map<GraphId,unsigned> level;
+    auto deps=detail::dependants(g);
+    vector<GraphId> frontier, next;
+    for (auto& i: g)
+      if (i.id()==source)
+        {
+          level[source]=0;
+          frontier.push_back(source);
+        }
+    for (unsigned depth=0; allReduce(frontier.size(),ReduceOp::sum)>0; ++depth)
+      {
+        auto ghosts=g.exchangeValues(frontier,level);
+        frontier.insert(frontier.end(),ghosts.begin(),ghosts.end());
+        next.clear();
+        for (auto f: frontier)
+          {
+            auto d=deps.find(f);
+            if (d==deps.end()) continue;
+            for (auto& e: d->second)
+              if (level.emplace(e.first.id(),depth+1).second)
+                next.push_back(e.first.id());
+          }
+        frontier.swap(next);
+      }
+    return level;
+  }
+
+  /**
+     connected components by minimum label propagation. Each object
+     is labelled with the smallest GraphId in its component.
+  */
+  template <class T>
+  std::unordered_map<GraphId,GraphId> connectedComponents(Graph<T>& g)
+  {
+    std::unordered_map<GraphId,GraphId> label;
+    auto deps=detail::dependants(g);
+    vector<GraphId> changed;
+    for (auto& i: g)
+      {
+        label[i.id()]=i.id();
+        changed.push_back(i.id());
+      }
+    std::unordered_set<GraphId> next;
+    while (allReduce(changed.size(),ReduceOp::sum)>0)
+      {
+        auto ghosts=g.exchangeValues(changed,label);
+        changed.insert(changed.end(),ghosts.begin(),ghosts.end());
+        next.clear();
+        for (auto f: changed)
+          {
+            auto d=deps.find(f);
+            if (d==deps.end()) continue;
+            auto l=label[f];
+            for (auto& e: d->second)
+              {
+                auto& lv=label[e.first.id()];
+                if (l<lv)
+                  {
+                    lv=l;
+                    next.insert(e.first.id());
+                  }
+              }
+          }
+        changed.assign(next.begin(),next.end());
+      }
+    return label;
+  }
+
+  /**
+     single source shortest paths (distributed Bellman-Ford), with
+     link lengths given by object::edgeWeight(). Unreachable objects
+     have infinite distance.
+  */
+  template <class T>
+  std::unordered_map<GraphId,double> shortestPaths(Graph<T>& g, GraphId source)
+  {
+    const double infinity=std::numeric_limits<double>::infinity();
+    std::unordered_map<GraphId,double> dist;
+    auto deps=detail::dependants(g);
+    vector<GraphId> changed;
+    for (auto& i: g)
+      if (i.id()==source)
+        {
+          dist[source]=0;
+          changed.push_back(source);
+        }
+      else
+        dist[i.id()]=infinity;
+    std::unordered_set<GraphId> next;
+    while (allReduce(changed.size(),ReduceOp::sum)>0)
+      {
+        auto ghosts=g.exchangeValues(changed,dist);
+        changed.insert(changed.end(),ghosts.begin(),ghosts.end());
+        next.clear();
+        for (auto f: changed)
+          {
+            auto d=deps.find(f);
+            if (d==deps.end()) continue;
+            double df=dist[f];
+            for (auto& e: d->second)
+              {
+                double candidate=df+e.first->edgeWeight(e.second);
+                auto& dv=dist[e.first.id()];
+                if (candidate<dv)
+                  {
+                    dv=candidate;
+                    next.insert(e.first.id());
+                  }
+              }
+          }
+        changed.assign(next.begin(),next.end());
+      }
+    return dist;
+  }
+
+  /**
+     PageRank, with dangling objects' rank redistributed uniformly.
+     Iterates until the L1 change in rank falls below \a tolerance, or
+     \a maxIter iterations. Returns ranks of locally hosted objects.
+  */
+  template <class T>
+  std::unordered_map<GraphId,double> pageRank
+  (Graph<T>& g, double damping=0.85, double tolerance=1e-8, unsigned maxIter=100)
+  {
+    double n=allReduce(g.size(),ReduceOp::sum);
+    std::unordered_map<GraphId,double> rank, contribution;
+    vector<GraphId> local;
+    for (auto& i: g)
+      {
+        rank[i.id()]=1/n;
+        local.push_back(i.id());
+      }
+    for (unsigned iter=0; iter<maxIter; ++iter)
+      {
+        double dangling=0;
+        for (auto& i: g)
+          if (unsigned d=detail::degree(i))
+            contribution[i.id()]=rank[i.id()]/d;
+          else
+            {
+              contribution[i.id()]=0;
+              dangling+=rank[i.id()];
+            }
+        /* every contribution changes each iteration */
+        g.exchangeValues(local,contribution);
+        dangling=allReduce(dangling,ReduceOp::sum);
+
+        double delta=0;
+        for (auto& i: g)
+          {
+            double sum=0;
+            for (auto& nbr: *i)
+              if (nbr.id()!=i.id())
+                sum+=contribution[nbr.id()];
+            double r=(1-damping)/n + damping*(sum+dangling/n);
+            delta+=std::fabs(r-rank[i.id()]);
+            rank[i.id()]=r;
+          }
+        if (allReduce(delta,ReduceOp::sum)<tolerance) break;
+      }
+    return rank;
+  }
+
+  /**
+     core number of each object: the largest k such that the object
+     belongs to the k-core. The k-core comprises the objects with core
+     number \f$\geq k\f$. Computed by iterated h-index estimates,
+     which only change for objects with a changed neighbour.
+  */
+  template <class T>
+  std::unordered_map<GraphId,unsigned> coreNumbers(Graph<T>& g)
+  {
+    std::unordered_map<GraphId,unsigned> core;
+    auto deps=detail::dependants(g);
+    vector<GraphId> changed;
+    for (auto& i: g)
+      {
+        core[i.id()]=detail::degree(i);
+        changed.push_back(i.id());
+      }
+    std::unordered_map<GraphId,ObjRef> candidates;
+    vector<unsigned> estimates;
+    while (allReduce(changed.size(),ReduceOp::sum)>0)
+      {
+        auto ghosts=g.exchangeValues(changed,core);
+        changed.insert(changed.end(),ghosts.begin(),ghosts.end());
+        candidates.clear();
+        for (auto f: changed)
+          {
+            auto d=deps.find(f);
+            if (d==deps.end()) continue;
+            for (auto& e: d->second)
+              candidates.emplace(e.first.id(),e.first);
+          }
+        changed.clear();
+        for (auto& c: candidates)
+          {
+            auto& v=c.second;
+            estimates.clear();
+            for (auto& n: *v)
+              if (n.id()!=v.id())
+                estimates.push_back(core[n.id()]);
+            unsigned h=detail::hIndex(estimates);
+            auto& cv=core[v.id()];
+            if (h<cv)
+              {
+                cv=h;
+                changed.push_back(v.id());
+              }
+          }
+      }
+    return core;
+  }
+
+  /// total number of triangles in the graph
+  template <class T>
+  unsigned long triangleCount(Graph<T>& g)
+  {
+    /* sorted adjacency of local objects, and their cached neighbours */
+    std::unordered_map<GraphId, vector<GraphId> > adj;
+    vector<GraphId> local;
+    for (auto& i: g)
+      {
+        auto& a=adj[i.id()];
+        for (auto& n: *i)
+          if (n.id()!=i.id())
+            a.push_back(n.id());
+        std::sort(a.begin(),a.end());
+        a.erase(std::unique(a.begin(),a.end()),a.end());
+        local.push_back(i.id());
+      }
+    g.exchangeValues(local,adj);
+
+    /* count each triangle v<u<w once, on v's processor */
+    unsigned long count=0;
+    for (auto v: local)
+      {
+        auto& av=adj[v];
+        for (auto u: av)
+          {
+            if (u<=v) continue;
+            auto au=adj.find(u);
+            if (au==adj.end()) continue;
+            count+=detail::intersectionSize
+              (std::upper_bound(av.begin(),av.end(),u), av.end(),
+               std::upper_bound(au->second.begin(),au->second.end(),u), au->second.end());
+          }
+      }
+    return allReduce(count,ReduceOp::sum);
+  }
+}
+
+#endif
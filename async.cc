@@ -0,0 +1,149 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <list>
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  struct GraphBase::AsyncState
+  {
+#ifdef MPI_SUPPORT
+    int tag=0;
+    /* nonblocking sends in flight - MPIbufs must not move until sent */
+    std::list<MPIbuf> pending;
+    long sent=0, received=0;
+    /* termination wave: {active processors, messages sent, messages received} */
+    long local[3], global[3], previous[3]={-1,-1,-1};
+    MPI_Request wave=MPI_REQUEST_NULL;
+#endif
+  };
+
+  void GraphBase::beginAsync()
+  {
+    asyncState.reset(new AsyncState);
+#ifdef MPI_SUPPORT
+    if (nprocs()==1) return;
+    prepareNeighbours(true);
+    tag++;
+    asyncState->tag=tag;
+#endif
+  }
+
+  void GraphBase::asyncSend(const vector<GraphId>& changed)
+  {
+#ifdef MPI_SUPPORT
+    if (nprocs()==1) return;
+    AsyncState& s=*asyncState;
+    /* reap completed sends */
+    for (auto i=s.pending.begin(); i!=s.pending.end();)
+      if (i->sent())
+        i=s.pending.erase(i);
+      else
+        ++i;
+
+    /* one message per subscribing processor, packed in place */
+    vector<MPIbuf*> sendbuf(nprocs(),nullptr);
+    for (auto id: changed)
+      {
+        auto sub=subscribers.find(id);
+        if (sub==subscribers.end()) continue; /* not a boundary object */
+        for (auto proc: sub->second)
+          {
+            if (!sendbuf[proc])
+              {
+                s.pending.emplace_back();
+                sendbuf[proc]=&s.pending.back();
+              }
+            *sendbuf[proc] << id << objectRef(id);
+          }
+      }
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      if (sendbuf[proc])
+        {
+          sendbuf[proc]->isend(proc,s.tag);
+          s.sent++;
+        }
+#endif
+  }
+
+  unsigned GraphBase::asyncReceive()
+  {
+    unsigned r=0;
+#ifdef MPI_SUPPORT
+    if (nprocs()==1) return r;
+    AsyncState& s=*asyncState;
+    for (;;)
+      {
+        int waiting;
+        MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE,s.tag,MPI_COMM_WORLD,&waiting,&status);
+        if (!waiting) break;
+        MPIbuf b; b.get(status.MPI_SOURCE,s.tag);
+        while (b.pos()<b.size())
+          {
+            GraphId id;
+            b>>id;
+            b>>objectRef(id);
+          }
+        s.received++;
+        r++;
+      }
+    if (r) localIndexData.stale=true;
+#endif
+    return r;
+  }
+
+  bool GraphBase::asyncTerminated(bool quiescent)
+  {
+#ifdef MPI_SUPPORT
+    if (nprocs()==1) return quiescent;
+    AsyncState& s=*asyncState;
+    /*
+       Counting termination detector (Mattern's four counter method):
+       a nonblocking reduction wave samples activity and message counts
+       on every processor. Termination is declared when two
+       consecutive waves see all processors passive, and identical
+       totals of messages sent and received. As every processor takes
+       part in the same sequence of waves, they all agree on the
+       outcome.
+    */
+    if (s.wave!=MPI_REQUEST_NULL)
+      {
+        int done;
+        MPI_Test(&s.wave,&done,MPI_STATUS_IGNORE);
+        if (!done) return false;
+        bool terminated=s.global[0]==0 && s.global[1]==s.global[2] &&
+          std::equal(s.global,s.global+3,s.previous);
+        std::copy(s.global,s.global+3,s.previous);
+        if (terminated) return true;
+      }
+    s.local[0]=!quiescent;
+    s.local[1]=s.sent;
+    s.local[2]=s.received;
+    MPI_Iallreduce(s.local,s.global,3,MPI_LONG,MPI_SUM,MPI_COMM_WORLD,&s.wave);
+    return false;
+#else
+    return quiescent;
+#endif
+  }
+
+  void GraphBase::endAsync()
+  {
+#ifdef MPI_SUPPORT
+    if (asyncState)
+      for (auto& b: asyncState->pending)
+        b.wait();
+#endif
+    asyncState.reset();
+  }
+}
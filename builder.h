@@ -0,0 +1,96 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/**
+   Concurrent construction of a Graph from many threads. Objects are
+   inserted into a table sharded by id hash, each shard with its own
+   lock, so threads inserting different objects rarely contend, and
+   objects are constructed outside any lock. freeze() then moves the
+   objects into the Graph, and builds their links.
+*/
+
+#ifndef GRAPHCODE_BUILDER_H
+#define GRAPHCODE_BUILDER_H
+
+#include "graphcode.h"
+#include <mutex>
+#include <thread>
+
+namespace graphcode
+{
+  template <class T>
+  class GraphBuilder
+  {
+    /* aligned, so that threads locking neighbouring shards do not share a cache line */
+    struct alignas(64) Shard
+    {
+      std::mutex mutex;
+      std::unordered_map<GraphId,ObjectPtr<T> > objects;
+    };
+    Graph<T>& graph;
+    vector<Shard> shards;
+    Shard& shard(GraphId id)
+    {return shards[((uint64_t(id)*0x9E3779B97F4A7C15ULL)>>32)%shards.size()];}
+  public:
+    /// build into \a graph. By default, 64 shards are used per hardware thread
+    explicit GraphBuilder(Graph<T>& graph, size_t nShards=0):
+      graph(graph), shards(nShards? nShards: 64*std::max(1U,std::thread::hardware_concurrency())) {}
+
+    /**
+       add an object of type U if none already present, as
+       Graph::insertObject. May be called from many threads at once.
+       - returns the object's entry, on which \c proc and the object's
+         \c neighbours may be set. The entry remains valid until freeze()
+       - threads inserting the same id share the one object, so
+         should not both modify it
+       - ids already in the Graph are not seen here. Objects inserted
+         with those ids are discarded by freeze()
+    */
+    template <class U=T, class... Args>
+    ObjectPtr<T>& insertObject(GraphId id, Args&&... args)
+    {
+      auto& s=shard(id);
+      {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto i=s.objects.find(id);
+        if (i!=s.objects.end()) return i->second;
+      }
+      ObjectPtr<T> o(id, std::allocate_shared<U>(graph.cellAlloc,std::forward<Args>(args)...));
+      std::lock_guard<std::mutex> lock(s.mutex);
+      /* another thread may have got in first, in which case its object is kept */
+      return s.objects.emplace(id,std::move(o)).first->second;
+    }
+
+    /**
+       move the objects built into the Graph, and rebuild its links,
+       with the parallel bulk path for large graphs (see
+       GraphBase::bulkLinkThreshold). Call from one thread, after all
+       insertions are complete. The builder may then be reused.
+    */
+    void freeze()
+    {
+      size_t n=graph.objects.size();
+      for (auto& s: shards) n+=s.objects.size();
+      graph.objects.reserve(n);
+      for (auto& s: shards)
+        for (auto& i: s.objects)
+          graph.insertObject(i.second);
+      /* releasing the builder's references is spread across threads */
+      long nShards=shards.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for (long i=0; i<nShards; i++)
+        shards[i].objects.clear();
+      graph.rec_req.clear();
+      graph.rebuildPtrLists();
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,246 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <cstdio>
+#include <stdexcept>
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+/*
+  Each processor writes its own files:
+  - prefix.<proc>.<n> holds checkpoint n: the ids of objects no longer
+    hosted since checkpoint n-1, then the hosted objects that changed.
+    A base checkpoint holds every hosted object.
+  - prefix.<proc>.head records the previous and current base, and the
+    last checkpoint written, and is replaced atomically.
+
+  Files older than the previous base are removed only once all
+  processors have recorded a new base. A restore then always finds a
+  base and deltas up to the last checkpoint completed everywhere.
+*/
+
+namespace graphcode
+{
+  namespace
+  {
+    std::string fileName(const std::string& prefix, const std::string& suffix)
+    {return prefix+"."+std::to_string(myid())+"."+suffix;}
+
+    std::string fileName(const std::string& prefix, unsigned long n)
+    {return fileName(prefix,std::to_string(n));}
+
+    void writeFile(const std::string& name, pack_t& b)
+    {
+      FILE* f=fopen(name.c_str(),"wb");
+      if (!f) throw std::runtime_error("cannot open "+name);
+      bool ok=fwrite(b.data(),1,b.size(),f)==b.size();
+      ok=fclose(f)==0 && ok;
+      if (!ok) throw std::runtime_error("cannot write "+name);
+    }
+
+    void readFile(const std::string& name, pack_t& b)
+    {
+      FILE* f=fopen(name.c_str(),"rb");
+      if (!f) throw std::runtime_error("cannot open "+name);
+      fseek(f,0,SEEK_END);
+      vector<char> buf(ftell(f));
+      fseek(f,0,SEEK_SET);
+      bool ok=fread(buf.data(),1,buf.size(),f)==buf.size();
+      fclose(f);
+      if (!ok) throw std::runtime_error("cannot read "+name);
+      b.packraw(buf.data(),buf.size());
+    }
+
+    /// hash of the ids \a o links to, so that changes to links alone are saved
+    size_t linkHash(const object& o)
+    {
+      size_t h=o.relations.size();
+      auto mix=[&](GraphId n) {h=(h^std::hash<GraphId>()(n))*0x100000001b3ULL;};
+      o.forEachNeighbourId(mix);
+      for (auto& r: o.relations)
+        {
+          mix(r.size());
+          for (auto n: r) mix(n);
+        }
+      return h;
+    }
+
+    template <class S>
+    void writeHead(const S& s)
+    {
+      pack_t b;
+      b<<nprocs()<<s.prevBase<<s.base<<s.seq;
+      auto head=fileName(s.prefix,"head"), tmp=head+".tmp";
+      writeFile(tmp,b);
+      if (std::rename(tmp.c_str(),head.c_str()))
+        throw std::runtime_error("cannot write "+head);
+    }
+  }
+
+  void GraphBase::checkpoint(const std::string& prefix)
+  {
+    auto& s=checkpointState;
+    if (s.prefix!=prefix)
+      {
+        s.versions.clear();
+        s.seq=s.base=s.prevBase=0;
+        s.prefix=prefix;
+      }
+    s.seq++;
+    bool full=s.base==0 || s.seq-s.base>=compactInterval;
+
+    std::unordered_map<GraphId,CheckpointState::Saved> versions;
+    versions.reserve(size());
+    for (auto& i: *this)
+      versions.emplace(i.id(),CheckpointState::Saved{i->version,linkHash(*i)});
+
+    vector<GraphId> removed;
+    if (!full)
+      for (auto& v: s.versions)
+        if (!versions.count(v.first))
+          removed.push_back(v.first);
+    vector<ObjRef> changed;
+    for (auto& i: *this)
+      {
+        auto v=s.versions.find(i.id());
+        if (full || v==s.versions.end() || !(v->second==versions[i.id()]))
+          changed.push_back(i);
+      }
+
+    pack_t b;
+    b<<removed<<changed.size();
+    for (auto& i: changed)
+      b<<i.id()<<*i.payload;
+    writeFile(fileName(prefix,s.seq),b);
+    s.versions.swap(versions);
+
+    if (full)
+      {
+        s.prevBase=s.base;
+        s.base=s.seq;
+      }
+    writeHead(s);
+    if (full && s.prevBase)
+      {
+#ifdef MPI_SUPPORT
+        /* every processor has now recorded the new base */
+        MPI_Barrier(MPI_COMM_WORLD);
+#endif
+        for (auto n=s.prevBase; n<s.base; n++)
+          std::remove(fileName(prefix,n).c_str());
+        s.prevBase=s.base;
+        writeHead(s);
+      }
+  }
+
+  void GraphBase::replayCheckpoint(const std::string& prefix)
+  {
+    auto& s=checkpointState;
+    s.versions.clear();
+    s.prefix=prefix;
+    pack_t h;
+    readFile(fileName(prefix,"head"),h);
+    unsigned np;
+    h>>np>>s.prevBase>>s.base>>s.seq;
+    if (np!=nprocs())
+      throw std::runtime_error("checkpoint "+prefix+" was written by "+
+                               std::to_string(np)+" processors");
+    /* the last checkpoint completed by all processors */
+    s.seq=allReduce(s.seq,ReduceOp::min);
+    if (s.base>s.seq) s.base=s.prevBase;
+    s.prevBase=s.base;
+
+    for (auto n=s.base; n<=s.seq; n++)
+      {
+        pack_t b;
+        readFile(fileName(prefix,n),b);
+        vector<GraphId> removed;
+        size_t nChanged;
+        b>>removed>>nChanged;
+        for (auto id: removed)
+          {
+            objectRef(id).reset();
+            s.versions.erase(id);
+          }
+        for (size_t i=0; i<nChanged; i++)
+          {
+            GraphId id;
+            b>>id;
+            auto& o=objectRef(id);
+            b>>o;
+            s.versions[id]=CheckpointState::Saved{o->version,linkHash(*o)};
+          }
+      }
+    /* later checkpoints continue from here */
+    writeHead(s);
+  }
+
+  std::unordered_map<GraphId,unsigned> GraphBase::lookupHosts
+  (const vector<GraphId>& hosted, const std::unordered_set<GraphId>& wanted)
+  {
+    std::unordered_map<GraphId,unsigned> found;
+#ifdef MPI_SUPPORT
+    /* the host of each id is registered with, and looked up from, the
+       processor loadOwner(id), so no processor holds every id */
+    vector<vector<GraphId> > reg(nprocs()), query(nprocs());
+    for (auto id: hosted) reg[loadOwner(id)].push_back(id);
+    for (auto id: wanted) query[loadOwner(id)].push_back(id);
+    tag++;
+    MPIbuf_array sendbuf(nprocs());
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      {
+        sendbuf[proc] << reg[proc] << query[proc];
+        if (proc!=myid()) sendbuf[proc].isend(proc,tag);
+      }
+    std::unordered_map<GraphId,unsigned> hosts;
+    vector<vector<GraphId> > queries(nprocs());
+    auto registerHosts=[&](MPIbuf& b, unsigned proc) {
+      vector<GraphId> ids;
+      b >> ids >> queries[proc];
+      for (auto id: ids) hosts[id]=proc;
+    };
+    registerHosts(sendbuf[myid()],myid());
+    for (unsigned i=0; i<nprocs()-1; i++)
+      {
+        MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+        registerHosts(b,b.proc);
+      }
+
+    /* answer the queries */
+    tag++;
+    MPIbuf_array replies(nprocs());
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      {
+        for (auto id: queries[proc])
+          {
+            auto h=hosts.find(id);
+            if (h!=hosts.end()) replies[proc] << id << h->second;
+          }
+        if (proc!=myid()) replies[proc].isend(proc,tag);
+      }
+    auto readReplies=[&](MPIbuf& b) {
+      while (b.pos()<b.size())
+        {
+          GraphId id; unsigned proc;
+          b >> id >> proc;
+          found[id]=proc;
+        }
+    };
+    readReplies(replies[myid()]);
+    for (unsigned i=0; i<nprocs()-1; i++)
+      {
+        MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+        readReplies(b);
+      }
+#endif
+    return found;
+  }
+}
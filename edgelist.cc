@@ -0,0 +1,169 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  namespace
+  {
+    /// offset of the first line starting at or after \a offset
+    size_t lineStart(FILE* f, size_t offset, size_t fileSize)
+    {
+      if (offset==0 || offset>=fileSize) return std::min(offset,fileSize);
+      fseek(f,offset-1,SEEK_SET);
+      int c;
+      while ((c=fgetc(f))!=EOF && c!='\n') offset++;
+      return std::min(offset,fileSize);
+    }
+
+    /// parse an unsigned decimal integer at \a p, advancing \a p
+    inline bool parseId(const char*& p, const char* e, GraphId& x)
+    {
+      while (p<e && (*p==' ' || *p=='\t' || *p==',' || *p=='\r')) ++p;
+      if (p==e || *p<'0' || *p>'9') return false;
+      x=0;
+      for (; p<e && *p>='0' && *p<='9'; ++p)
+        x=10*x+(*p-'0');
+      return true;
+    }
+
+    /// adds edge pairs to per processor outgoing buffers
+    struct EdgeSink
+    {
+      bool undirected;
+      vector<vector<GraphId> > out;
+      EdgeSink(bool undirected): undirected(undirected), out(nprocs()) {}
+      void operator()(GraphId from, GraphId to)
+      {
+        auto& a=out[GraphBase::loadOwner(from)];
+        a.push_back(from);
+        a.push_back(to);
+        /* ensure the object linked to is created by its host */
+        auto& b=out[GraphBase::loadOwner(to)];
+        b.push_back(to);
+        b.push_back(undirected? from: badId);
+      }
+    };
+
+    /// parse the complete lines in [p,e)
+    void parseLines(const char* p, const char* e, EdgeSink& sink)
+    {
+      while (p<e)
+        {
+          const char* eol=static_cast<const char*>(memchr(p,'\n',e-p));
+          if (!eol) eol=e;
+          GraphId from, to;
+          const char* q=p;
+          while (q<eol && (*q==' ' || *q=='\t')) ++q;
+          if (q<eol && *q!='#' && *q!='%' && parseId(q,eol,from) && parseId(q,eol,to))
+            sink(from,to);
+          p=eol+1;
+        }
+    }
+
+    void addEdges(const vector<GraphId>& edges, std::unordered_map<GraphId,vector<GraphId> >& links)
+    {
+      for (size_t i=0; i<edges.size(); i+=2)
+        {
+          auto& l=links[edges[i]];
+          if (edges[i+1]!=badId) l.push_back(edges[i+1]);
+        }
+    }
+  }
+
+  std::unordered_map<GraphId,vector<GraphId> > GraphBase::readEdgeList
+  (const std::string& filename, bool undirected, size_t batchBytes)
+  {
+    std::unordered_map<GraphId,vector<GraphId> > links;
+    FILE* f=fopen(filename.c_str(),"rb");
+    if (!f) throw std::runtime_error("cannot open "+filename);
+    fseek(f,0,SEEK_END);
+    size_t fileSize=ftell(f);
+
+    /* this processor parses the lines starting in its byte range */
+    size_t pos=lineStart(f,fileSize*myid()/nprocs(),fileSize);
+    size_t end=lineStart(f,fileSize*(myid()+1)/nprocs(),fileSize);
+    fseek(f,pos,SEEK_SET);
+
+    EdgeSink sink(undirected);
+    vector<char> buf;
+    size_t carry=0; /* bytes of an incomplete line carried between batches */
+    for (bool more=true; ;)
+      {
+        if (more)
+          {
+            size_t n=std::min(batchBytes,end-pos);
+            buf.resize(carry+n);
+            n=fread(buf.data()+carry,1,n,f);
+            pos+=n;
+            more=n>0 && pos<end;
+            size_t complete=carry+n;
+            if (more)
+              {
+                /* retain the trailing partial line for the next batch */
+                while (complete>0 && buf[complete-1]!='\n') complete--;
+              }
+            parseLines(buf.data(),buf.data()+complete,sink);
+            carry=carry+n-complete;
+            memmove(buf.data(),buf.data()+complete,carry);
+          }
+
+#ifdef MPI_SUPPORT
+        if (nprocs()>1)
+          {
+            /* shuffle this batch of edges to their hosts */
+            vector<int> sendCounts(nprocs()), recvCounts(nprocs()),
+              sendDispls(nprocs()), recvDispls(nprocs());
+            vector<GraphId> sendbuf;
+            for (unsigned p=0; p<nprocs(); p++)
+              {
+                sendDispls[p]=sendbuf.size();
+                sendCounts[p]=sink.out[p].size();
+                sendbuf.insert(sendbuf.end(),sink.out[p].begin(),sink.out[p].end());
+                sink.out[p].clear();
+              }
+            MPI_Alltoall(sendCounts.data(),1,MPI_INT,recvCounts.data(),1,MPI_INT,MPI_COMM_WORLD);
+            int total=0;
+            for (unsigned p=0; p<nprocs(); p++)
+              {
+                recvDispls[p]=total;
+                total+=recvCounts[p];
+              }
+            vector<GraphId> recvbuf(total);
+            auto type=detail::MPIType<GraphId>::t();
+            MPI_Alltoallv(sendbuf.data(),sendCounts.data(),sendDispls.data(),type,
+                          recvbuf.data(),recvCounts.data(),recvDispls.data(),type,
+                          MPI_COMM_WORLD);
+            addEdges(recvbuf,links);
+            if (!allReduce(int(more),ReduceOp::max)) break;
+            continue;
+          }
+#endif
+        addEdges(sink.out[0],links);
+        sink.out[0].clear();
+        if (!more) break;
+      }
+    fclose(f);
+
+    /* remove duplicates, such as undirected edges listed both ways */
+    for (auto& l: links)
+      {
+        std::sort(l.second.begin(),l.second.end());
+        l.second.erase(std::unique(l.second.begin(),l.second.end()),l.second.end());
+      }
+    return links;
+  }
+}
@@ -36,6 +36,15 @@ typedef int idx_t;  /* just for defining dummy weight functions */
 
 #include <vector>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
 #include <algorithm>
 #include <iostream>
 
@@ -236,27 +245,165 @@ namespace graphcode
     }
   };
   
+  /**
+     A list of ids compressed by sorting, then storing the differences
+     between successive ids as variable length integers, 7 bits per
+     byte with the top bit marking continuation. Neighbouring ids on
+     large sparse graphs mostly differ by small amounts, so take one
+     or two bytes rather than eight.
+  */
+  struct CompressedIds
+  {
+    std::vector<uint8_t> data;
+    size_t count=0; ///< number of ids
+    CompressedIds()=default;
+    explicit CompressedIds(std::vector<GraphId> ids)
+    {
+      std::sort(ids.begin(),ids.end());
+      data.reserve(ids.size()*2);
+      GraphId prev=0;
+      for (auto id: ids)
+        {
+          uint64_t d=id-prev;
+          prev=id;
+          for (; d>=0x80; d>>=7)
+            data.push_back(uint8_t(d)|0x80);
+          data.push_back(uint8_t(d));
+        }
+      data.shrink_to_fit();
+      count=ids.size();
+    }
+    size_t size() const {return count;}
+    bool empty() const {return count==0;}
+    /// call \a f with each id, in ascending order, decoding as it goes
+    template <class F> void forEach(F f) const
+    {
+      GraphId id=0;
+      for (size_t i=0; i<data.size();)
+        {
+          uint64_t d=0;
+          for (unsigned shift=0; ; shift+=7)
+            {
+              uint8_t b=data[i++];
+              d|=uint64_t(b&0x7f)<<shift;
+              if (!(b&0x80)) break;
+            }
+          id+=d;
+          f(id);
+        }
+    }
+    std::vector<GraphId> decode() const
+    {
+      std::vector<GraphId> r;
+      r.reserve(count);
+      forEach([&](GraphId id) {r.push_back(id);});
+      return r;
+    }
+  };
+
   /** 
       base class for Graphcode objects.  an object, first and foremost
       is a \c Ptrlist of other objects it is connected to (maybe its
       neighbours, maybe its classes or families to which it belongs)
+
+      The PtrList follows the order of \c neighbours, unless they are
+      compressed (see compressNeighbours and
+      GraphBase::compressedAdjacency). Compression sorts them by id,
+      so the links no longer follow the order they were given in, and
+      kernels that rely on a neighbour's position (eg the first link
+      being the left neighbour) must not use compression.
   */
   class object: public Exclude<PtrList>, public classdesc::object, public classdesc::PolyRESTProcessBase
   {
   public:
+    /// neighbours not yet compressed, see compressNeighbours
     std::vector<GraphId> neighbours;
+    /// compressed neighbours, in ascending id order, followed logically by \c neighbours
+    CompressedIds compressedNeighbours;
+    /**
+       move \c neighbours into \c compressedNeighbours, releasing
+       their storage. Links added to \c neighbours afterwards are
+       merged by the next call.
+       - all neighbours are reordered into ascending id order, as is
+         the PtrList once rebuilt
+    */
+    void compressNeighbours() {
+      if (neighbours.empty()) return;
+      if (!compressedNeighbours.empty())
+        {
+          auto ids=compressedNeighbours.decode();
+          ids.insert(ids.end(),neighbours.begin(),neighbours.end());
+          neighbours.swap(ids);
+        }
+      compressedNeighbours=CompressedIds(std::move(neighbours));
+      std::vector<GraphId>().swap(neighbours);
+    }
+    /**
+       restore all neighbours to \c neighbours, in the order
+       forEachNeighbourId gives them. The order they had before
+       compression is not recovered.
+    */
+    void expandNeighbours() {
+      if (compressedNeighbours.empty()) return;
+      auto ids=compressedNeighbours.decode();
+      ids.insert(ids.end(),neighbours.begin(),neighbours.end());
+      neighbours.swap(ids);
+      compressedNeighbours=CompressedIds();
+    }
+    /// number of neighbours, compressed or not
+    size_t neighbourCount() const {return compressedNeighbours.size()+neighbours.size();}
+    /// call \a f with the id of each neighbour, compressed ones first
+    template <class F> void forEachNeighbourId(F f) const {
+      compressedNeighbours.forEach(f);
+      for (auto n: neighbours) f(n);
+    }
+    /// links of further edge relations (see GraphBase::addRelation), relation r>0 being relations[r-1]
+    std::vector<std::vector<GraphId> > relations;
+    /**
+       ids linked to in relation \a r, relation 0 being \c neighbours
+       - relation 0 may only be used while no neighbours are
+         compressed, as the compressed ones are not in the list. Use
+         forEachLinkId instead.
+    */
+    std::vector<GraphId>& linkIds(unsigned r) {
+      assert(r>0 || compressedNeighbours.empty());
+      if (r==0) return neighbours;
+      if (relations.size()<r) relations.resize(r);
+      return relations[r-1];
+    }
+    const std::vector<GraphId>& linkIds(unsigned r) const {
+      static const std::vector<GraphId> none;
+      assert(r>0 || compressedNeighbours.empty());
+      if (r==0) return neighbours;
+      return r<=relations.size()? relations[r-1]: none;
+    }
+    /// call \a f with each id linked to in relation \a r, including compressed neighbours
+    template <class F> void forEachLinkId(unsigned r, F f) const {
+      if (r==0) return forEachNeighbourId(f);
+      for (auto n: linkIds(r)) f(n);
+    }
+    /// incremented whenever the object may have changed. Ghosts carry their host's version.
+    unsigned long version=0;
+    /**
+       record a change of state, so that the versioned halo exchange
+       resends this object, and the next checkpoint saves it. Reading
+       or writing through as() does not record anything, so kernels
+       updating an object must call this, or GraphBase::markChanged.
+    */
+    void touch() {++version;}
     /// construct the internal pointer-based neighbour list, given the list of neighbours in \a neighbours
     template <class OMap> void updatePtrList(const OMap& o, const Allocator& alloc={}) {
       clear();
       setAllocator(alloc);
-      for (auto& n: neighbours) {
+      reserve(neighbourCount());
+      forEachNeighbourId([&](GraphId n) {
         auto i=o.find(n);
         if (i!=o.end())
           {
             assert(*i);
             emplace_back(*i);
           }
-      }
+      });
     }
     /// clone an object of a particular type. Note it is incorrect to
     /// call this method on an object that is not T. Runtime checks
@@ -280,7 +427,15 @@ namespace graphcode
 #endif
       return static_cast<const T*>(this);
     }
+    /// bytes occupied by the object, excluding its links. Override to add memory the object owns
+    virtual size_t objectSize() const {return sizeof(object);}
     virtual idx_t weight() const {return 1;} ///< node's weight (for partitioning)
+    /**
+       weights for multi-constraint partitioning, eg compute cost,
+       memory footprint and halo size, each balanced separately. All
+       objects should return the same number of weights.
+    */
+    virtual vector<idx_t> weights() const {return {weight()};}
     /// weight for edge connecting \c *this to \a x
     virtual idx_t edgeWeight(const ObjRef& x) const {return 1;} 
   };
@@ -289,6 +444,7 @@ namespace graphcode
   template <class T, class Base=object>
   struct Object: public classdesc::Object<T,Base>
   {
+    size_t objectSize() const override {return sizeof(T);}
     void RESTProcess(RESTProcess_t& r,const classdesc::string& d) override
     {
       classdesc::RESTProcess(r,d,static_cast<T&>(*this));
@@ -367,19 +523,439 @@ namespace graphcode
     }
   };
 
+  /// built in operations for global reductions
+  enum class ReduceOp {sum, min, max, maxLoc};
+
+  /// value and location of a maximum, for argmax reductions
+  struct MaxLoc
+  {
+    double value=-std::numeric_limits<double>::infinity();
+    GraphId id=badId;
+    MaxLoc() {}
+    MaxLoc(double value, GraphId id): value(value), id(id) {}
+    /// combine with \a x, preferring the smaller id in a tie
+    MaxLoc combine(const MaxLoc& x) const {
+      return x.value>value || (x.value==value && x.id<id)? x: *this;
+    }
+  };
+
+  namespace detail
+  {
+#ifdef MPI_SUPPORT
+    template <class V> struct MPIType;
+    template <> struct MPIType<int> {static MPI_Datatype t() {return MPI_INT;}};
+    template <> struct MPIType<unsigned> {static MPI_Datatype t() {return MPI_UNSIGNED;}};
+    template <> struct MPIType<long> {static MPI_Datatype t() {return MPI_LONG;}};
+    template <> struct MPIType<unsigned long> {static MPI_Datatype t() {return MPI_UNSIGNED_LONG;}};
+    template <> struct MPIType<float> {static MPI_Datatype t() {return MPI_FLOAT;}};
+    template <> struct MPIType<double> {static MPI_Datatype t() {return MPI_DOUBLE;}};
+    template <> struct MPIType<MaxLoc> {
+      static MPI_Datatype t() {
+        static MPI_Datatype type=[]() {
+          MPI_Datatype r;
+          MPI_Type_contiguous(sizeof(MaxLoc),MPI_BYTE,&r);
+          MPI_Type_commit(&r);
+          return r;
+        }();
+        return type;
+      }
+    };
+
+    inline void maxLoc(void* in, void* inout, int* len, MPI_Datatype*)
+    {
+      auto x=static_cast<MaxLoc*>(in);
+      auto y=static_cast<MaxLoc*>(inout);
+      for (int i=0; i<*len; i++) y[i]=y[i].combine(x[i]);
+    }
+
+    inline MPI_Op mpiOp(ReduceOp op)
+    {
+      switch (op)
+        {
+        case ReduceOp::sum: return MPI_SUM;
+        case ReduceOp::min: return MPI_MIN;
+        case ReduceOp::max: return MPI_MAX;
+        case ReduceOp::maxLoc:
+          {
+            static MPI_Op r=[]() {
+              MPI_Op r;
+              MPI_Op_create(maxLoc,1,&r);
+              return r;
+            }();
+            return r;
+          }
+        }
+      return MPI_OP_NULL;
+    }
+#endif
+
+    /// present a scalar, or vector of scalars, as a reduction buffer
+    template <class V> struct ReduceBuffer
+    {
+      using Scalar=V;
+      static V* data(V& x) {return &x;}
+      static int size(const V&) {return 1;}
+    };
+    template <class V> struct ReduceBuffer<vector<V> >
+    {
+      using Scalar=V;
+      static V* data(vector<V>& x) {return x.data();}
+      static int size(const vector<V>& x) {return x.size();}
+    };
+  }
+
+  /**
+     Handle for a nonblocking global reduction of a scalar, or vector
+     of scalars, across all processors. Creating the handle starts the
+     reduction, so it must be created on all processors
+     simultaneously. Handles may be freely copied.
+  */
+  template <class V>
+  class Reduction
+  {
+    struct State
+    {
+      V local, global;
+#ifdef MPI_SUPPORT
+      MPI_Request request=MPI_REQUEST_NULL;
+#endif
+      State(const V& x): local(x), global(x) {}
+    };
+    std::shared_ptr<State> state;
+  public:
+    Reduction(const V& local, ReduceOp op): state(std::make_shared<State>(local))
+    {
+#ifdef MPI_SUPPORT
+      if (nprocs()>1)
+        {
+          using B=detail::ReduceBuffer<V>;
+          MPI_Iallreduce(B::data(state->local),B::data(state->global),B::size(local),
+                         detail::MPIType<typename B::Scalar>::t(),detail::mpiOp(op),
+                         MPI_COMM_WORLD,&state->request);
+        }
+#endif
+    }
+    /// true if the reduction has completed
+    bool test()
+    {
+#ifdef MPI_SUPPORT
+      int done=1;
+      if (state->request!=MPI_REQUEST_NULL)
+        MPI_Test(&state->request,&done,MPI_STATUS_IGNORE);
+      return done;
+#else
+      return true;
+#endif
+    }
+    /// wait for completion, returning the global result
+    const V& wait()
+    {
+#ifdef MPI_SUPPORT
+      if (state->request!=MPI_REQUEST_NULL)
+        MPI_Wait(&state->request,MPI_STATUS_IGNORE);
+#endif
+      return state->global;
+    }
+  };
+
+  /// blocking global reduction of \a x. Must be called on all processors simultaneously
+  template <class V> V allReduce(const V& x, ReduceOp op)
+  {return Reduction<V>(x,op).wait();}
+
+  /**
+     Compact addressing of the locally resident objects - hosted
+     objects and ghosts - by dense 32 bit indices. Links are held in
+     compressed sparse row form as indices, so reaching a neighbour's
+     data is one indexed load, rather than a chain through ObjRef,
+     ObjectPtrBase and shared_ptr. See GraphBase::localIndex().
+  */
+  struct LocalIndex
+  {
+    typedef uint32_t Index;
+    /// hosted objects have indices [0,hosted), ghosts [hosted,size())
+    Index hosted=0;
+    /// object with each index
+    vector<object*> cells;
+    /// id of the object with each index
+    vector<GraphId> ids;
+    /// links of object i are links[offsets[i]..offsets[i+1])
+    vector<Index> offsets, links;
+    /// cells need refreshing, as ghosts have been replaced
+    bool stale=false;
+
+    Index size() const {return cells.size();}
+    bool empty() const {return cells.empty();}
+    /// object with index \a i, as a \a T
+    template <class T> T& cell(Index i) const {return *static_cast<T*>(cells[i]);}
+    struct Range
+    {
+      const Index *b, *e;
+      const Index* begin() const {return b;}
+      const Index* end() const {return e;}
+      size_t size() const {return e-b;}
+    };
+    /// indices linked to by object \a i, in neighbour order
+    Range neighbours(Index i) const
+    {return {links.data()+offsets[i], links.data()+offsets[i+1]};}
+  };
+
+  template <class M, class Combine> class Messages;
+
+  /**
+     memory used on one processor, in bytes, by each graphcode
+     structure. Sizes of containers are from their capacities, so are
+     close estimates rather than exact.
+  */
+  struct MemoryUsage
+  {
+    size_t hosted=0; ///< locally hosted objects, excluding their links
+    size_t ghosts=0; ///< copies of objects hosted elsewhere, excluding their links
+    size_t entries=0; ///< the object table, including entries without an object
+    size_t objectRefs=0; ///< \c objectRefs, and the list of locally hosted objects
+    size_t neighbours=0; ///< ids of neighbours, and of further relations
+    size_t ptrLists=0; ///< links between objects
+    size_t plan=0; ///< ghost exchange plans and their inverses
+    size_t indices=0; ///< local index, blocks, relation adjacencies and hubs
+    size_t resident=0; ///< resident set size of the process
+    size_t peakResident=0; ///< high water mark of the resident set size
+    /**
+       highest resident set size seen during each kind of collective
+       phase, while GraphBase::trackMemoryPhases is set. The process
+       high water mark (ru_maxrss) never decreases, so a phase whose
+       peak lies below an earlier all time high is only credited with
+       the resident set size sampled at its start and end, and a phase
+       whose transient buffers are freed before it ends is then
+       underestimated.
+    */
+    std::map<std::string,size_t> phasePeak;
+    /// total of the graphcode structures
+    size_t total() const
+    {return hosted+ghosts+entries+objectRefs+neighbours+ptrLists+plan+indices;}
+  };
+
   class GraphBase: public PtrList
   {
   protected:
     vector<vector<GraphId> > rec_req; 
     vector<vector<GraphId> > requests; 
+    /// processors caching a copy of each locally hosted boundary object (inverse of rec_req)
+    Exclude<std::unordered_map<GraphId, vector<unsigned> > > subscribers;
+    /// locally hosted objects linking to each object (inverse of the local links)
+    Exclude<std::unordered_map<GraphId, vector<ObjRef> > > dependants;
+    /// locally hosted objects, followed by each layer of ghosts in turn
+    Exclude<vector<ObjRef> > haloOrder;
+    /// end of the locally hosted objects, then of each ghost layer, in \c haloOrder
+    Exclude<vector<size_t> > layerEnd;
+    /// objects marked as changed since the last call to advanceActive
+    Exclude<std::unordered_set<GraphId> > changedObjects;
     unsigned tag=0;  /* tag used to ensure message groups do not overlap */
+    /// ghost traffic since the last partitionObjects, for communication volume estimates
+    struct HaloTraffic
+    {
+      unsigned long bytes=0; ///< serialised ghost bytes received
+      unsigned rounds=0;     ///< exchanges of any kind
+      unsigned full=0;       ///< exchanges shipping every boundary object
+      /// number of frontier-sparse exchanges shipping each boundary object
+      std::unordered_map<GraphId,unsigned> sparse;
+      /// fraction of exchanges shipping object \a id
+      double rate(GraphId id) const {
+        if (rounds==0) return 1;
+        auto i=sparse.find(id);
+        return double(full+(i==sparse.end()? 0: i->second))/rounds;
+      }
+    };
+    Exclude<HaloTraffic> traffic;
     /// checks that objects all have unique keys (ids).
     virtual bool sane() const=0;
+    struct AsyncState; /* bookkeeping for asynchronous execution, see async.cc */
+    Exclude<std::shared_ptr<AsyncState>> asyncState;
+    struct SharedHaloState; /* node shared memory window, see shared_halo.cc */
+    Exclude<std::shared_ptr<SharedHaloState>> sharedHalo;
+    struct RMAHaloState; /* one sided windows, tied to the request plan, see rma_halo.cc */
+    Exclude<std::shared_ptr<RMAHaloState>> rmaHalo;
+    struct NeighbourhoodState; /* distributed graph communicator, see neighbourhood_halo.cc */
+    Exclude<std::shared_ptr<NeighbourhoodState>> neighbourhoodHalo;
+    /* ghost exchange implementations used by prepareNeighbours */
+    void haloTwoSided();
+    void haloSharedMemory();
+    void haloRMA();
+    void haloNeighbourhoodBegin();
+    void haloNeighbourhoodEnd();
+    void haloVersioned();
+    /**
+       build every object's links from its neighbour ids, as
+       object::updatePtrList does, by a parallel radix partitioned
+       hash join of all links against the object table in \c objectRefs
+    */
+    void bulkUpdatePtrLists(const PtrList::Allocator&);
+    /// version of each object in \c rec_req last sent to that processor
+    Exclude<vector<vector<unsigned long> > > sentVersions;
+    /// built by localIndex(), and discarded by rebuildPtrLists
+    Exclude<LocalIndex> localIndexData;
+    /// incremental checkpoint bookkeeping, see checkpoint.cc
+    struct CheckpointState
+    {
+      std::string prefix;
+      /// last checkpoint written, and the current and previous base checkpoints
+      unsigned long seq=0, base=0, prevBase=0;
+      /// version of each hosted object at the last checkpoint, and a hash of its links
+      struct Saved
+      {
+        unsigned long version;
+        size_t links;
+        bool operator==(const Saved& x) const
+        {return version==x.version && links==x.links;}
+      };
+      std::unordered_map<GraphId,Saved> versions;
+    };
+    Exclude<CheckpointState> checkpointState;
+    /// read hosted objects from the checkpoint files, for restoreCheckpoint
+    void replayCheckpoint(const std::string& prefix);
+    /**
+       processors hosting each of \a wanted, given the ids each
+       processor hosts, by way of a directory distributed by
+       loadOwner(). Ids hosted nowhere are omitted. Collective.
+    */
+    std::unordered_map<GraphId,unsigned> lookupHosts
+    (const vector<GraphId>& hosted, const std::unordered_set<GraphId>& wanted);
+    /// ghost exchange plan and adjacency of an edge relation, see relations.cc
+    struct RelationState
+    {
+      bool planned=false;
+      vector<vector<GraphId> > rec_req, requests;
+      /// links of the i'th hosted object are links[offsets[i]..offsets[i+1])
+      vector<size_t> offsets;
+      vector<ObjRef> links;
+    };
+    Exclude<vector<RelationState> > relationState;
+    Exclude<vector<std::string> > relationNames;
+    void buildRelation(unsigned r);
+    /// a high degree object whose links are cut across processors, see setupHubs
+    struct Hub
+    {
+      unsigned master=0; ///< processor hosting the hub
+      bool mirrored=false; ///< whether this processor holds a mirror
+      vector<unsigned> mirrors; ///< processors holding mirrors, on the master only
+    };
+    Exclude<std::unordered_map<GraphId,Hub> > hubs;
+    /// a collective phase in progress, see memory.cc
+    struct MemoryPhase
+    {
+      const char* kind;
+      size_t resident, peakResident; ///< at the start of the phase
+    };
+    Exclude<vector<MemoryPhase> > memoryPhases;
+    Exclude<std::map<std::string,size_t> > memoryPeaks;
+    void memoryPhaseBegin(const char* kind);
+    void memoryPhaseEnd();
+    struct TraceState; /* open trace file and step timing, see trace.cc */
+    Exclude<std::shared_ptr<TraceState>> traceState;
+    /* trace recording: exchanges may nest, only the outermost is recorded */
+    void traceExchangeBegin(const char* kind);
+    void traceExchangeEnd();
+    void traceMessage(unsigned proc, size_t bytes);
+    /// account for a ghost message of \a bytes received from \a proc
+    void haloReceived(unsigned proc, size_t bytes) {
+      traffic.bytes+=bytes;
+      traceMessage(proc,bytes);
+    }
     CLASSDESC_ACCESS(GraphBase);
+    template <class M, class Combine> friend class Messages;
   public:
     static bool typeRegistered(const graphcode::object& x) {return x.type()>=0;}
     PtrList objectRefs;
     virtual ObjectPtrBase& objectRef(GraphId)=0;
+    /// entry for object \a id, or nullptr if there is none
+    virtual ObjectPtrBase* findObject(GraphId)=0;
+
+    /// methods of exchanging ghost objects in prepareNeighbours
+    enum HaloBackend
+      {
+        twoSided, ///< point to point messages
+        /**
+           processors on the same node serialise the objects each
+           neighbour requests into their segment of an MPI-3 shared
+           memory window. Neighbours copy those bytes out of the
+           window and unpack them, saving the message passing, but
+           not the serialisation. Point to point messages are used
+           between nodes.
+        */
+        sharedMemory,
+        /**
+           each processor exposes its boundary objects in an RMA
+           window, and neighbours MPI_Get exactly the objects in their
+           cached request lists, synchronised by fences
+        */
+        rma,
+        /**
+           the request plan is turned into an MPI distributed graph
+           topology, and objects exchanged with
+           MPI_Ineighbor_alltoallv, so processors sharing no boundary
+           cost nothing. Communication proceeds in the background
+           between beginPrepareNeighbours and endPrepareNeighbours.
+        */
+        neighbourhood,
+        /**
+           as twoSided, but only objects whose version has moved since
+           they were last sent to a processor are sent. Other ghosts
+           keep their previous state, so a step changing nothing costs
+           an empty message per neighbouring processor. Kernels must
+           record their changes with object::touch or markChanged.
+        */
+        versioned
+      };
+    /// may be changed between steps, but must be the same on all processors
+    HaloBackend haloBackend=twoSided;
+    /**
+       number of links out from locally hosted objects to which ghosts
+       are cached. Must be at least 1, the same on all processors, and
+       the request plan recomputed after changing it.
+    */
+    unsigned haloDepth=1;
+    /**
+       Call \a f on each object to update at time step \a step,
+       where the halo is exchanged on steps that are multiples of
+       haloDepth: the locally hosted objects, followed by ghost layers
+       1 to haloDepth-1-(step%haloDepth), which are updated redundantly
+       so their neighbours' ghosts remain valid without exchange.
+    */
+    template <class F> void forUpdateSet(unsigned step, F f)
+    {
+      if (layerEnd.empty()) /* no plan, as on a single processor */
+        {
+          for (auto& i: *this) f(i);
+          return;
+        }
+      if (haloDepth==0)
+        throw std::runtime_error("haloDepth must be at least 1");
+      size_t layers=std::min<size_t>(haloDepth-1-step%haloDepth, layerEnd.size()-1);
+      for (size_t i=0; i<layerEnd[layers]; i++)
+        f(haloOrder[i]);
+    }
+
+    /**
+       Active set: locally hosted objects scheduled for the current
+       step. Kernels iterate over \c active rather than the whole
+       Graph, and call markChanged on any object they update.
+    */
+    PtrList active;
+    /**
+       when more than this fraction of locally hosted objects has
+       changed, advanceActive schedules every object, and sends every
+       requested object, rather than tracking the frontier
+    */
+    double denseThreshold=0.1;
+    /// mark locally hosted object \a id as changed in the current step
+    void markChanged(GraphId id) {
+      changedObjects.insert(id);
+      objectRef(id)->touch();
+    }
+    /// schedule all locally hosted objects, eg at the start of a simulation
+    void activateAll()
+    {
+      active.clear();
+      for (auto& i: *this) active.push_back(i);
+    }
 
     virtual ~GraphBase() {}
     
@@ -397,8 +973,9 @@ namespace graphcode
         if (i.proc()==myid())
           {
             references.insert(i.id());
-            for (auto id: i->neighbours)
-              references.insert(id);
+            i->forEachNeighbourId([&](GraphId id) {references.insert(id);});
+            for (auto& r: i->relations)
+              references.insert(r.begin(),r.end());
           }
       // now remove all unreferenced items
       for (auto& i: this->objectRefs)
@@ -430,20 +1007,419 @@ namespace graphcode
        - \a cache_requests=true means recompute the communication pattern
     */
     void prepareNeighbours(bool cache_requests=false);
+    /**
+       split phase prepareNeighbours. Computation not reading ghost
+       objects may be overlapped between the two calls. Only the
+       neighbourhood backend communicates in the background - the
+       others complete the exchange in beginPrepareNeighbours.
+    */
+    void beginPrepareNeighbours(bool cache_requests=false);
+    void endPrepareNeighbours();
+    /**
+       graphs with at least this many objects have their links built
+       by bulkUpdatePtrLists, rather than one hash lookup per link
+    */
+    size_t bulkLinkThreshold=10000;
+    /**
+       Dense local index of the hosted objects and ghosts, for kernels
+       reading neighbours by index rather than through ObjRef. Built on
+       first use after rebuildPtrLists. Ghost entries are refreshed
+       after advanceActive or asyncReceive replace ghost objects, so
+       call this again after any exchange rather than holding on to the
+       reference. Links to objects not present are omitted.
+    */
+    const LocalIndex& localIndex();
+    /// recompute the communication pattern used by prepareNeighbours
+    void updateRequests();
+
+    /**
+       Register a named edge relation, returning its number, or the
+       number already given to \a name. A relation's links are held
+       in object::linkIds(), and it has its own adjacency (links())
+       and ghost exchange plan (prepareRelation()), so a kernel
+       reading one relation only touches and communicates that
+       relation. Relation 0, "neighbours", is object::neighbours.
+       - relations must be registered in the same order on all processors
+    */
+    unsigned addRelation(const std::string& name);
+    /// number of relation \a name. Throws if it has not been registered
+    unsigned relation(const std::string& name) const;
+    struct Links
+    {
+      const ObjRef *b, *e;
+      const ObjRef* begin() const {return b;}
+      const ObjRef* end() const {return e;}
+      size_t size() const {return e-b;}
+    };
+    /**
+       objects present locally linked to by the \a i'th locally hosted
+       object in relation \a r. The adjacency of a relation is built
+       by the first call after rebuildPtrLists or a new plan for the
+       relation, so that call should not be made concurrently.
+    */
+    Links links(unsigned r, size_t i)
+    {
+      if (r>=relationState.size() || relationState[r].offsets.empty())
+        buildRelation(r);
+      auto& s=relationState[r];
+      return {s.links.data()+s.offsets[i], s.links.data()+s.offsets[i+1]};
+    }
+    /**
+       Exchange ghosts of just the objects linked to in relation \a r
+       by point to point messages. The relation's plan is kept until
+       the plan of prepareNeighbours is next recomputed.
+       - must be called on all processors simultaneously
+    */
+    void prepareRelation(unsigned r);
+
+    /**
+       keep neighbour ids compressed (see object::compressNeighbours):
+       rebuildPtrLists compresses any uncompressed neighbours, and
+       distributeObjects compresses them before sending. Objects then
+       also travel compressed in partitionObjects and ghost
+       exchanges. When cleared, rebuildPtrLists expands them again.
+       - NB compression sorts each object's neighbours, and so its
+         links, into ascending id order, losing the order they were
+         given in
+    */
+    bool compressedAdjacency=false;
+    /// objects with at least this many neighbours become hubs in setupHubs. 0 disables hubs
+    size_t hubDegree=0;
+    /**
+       Cut the links of hubs, objects of at least \c hubDegree
+       neighbours, across processors. Every processor hosting an
+       object linked with a hub, in either direction, holds a mirror
+       of it, whose neighbours are just those hosted there. Hubs are
+       left out of the ghost exchange, and their links carry the least
+       weight in partitioning, with mirrors kept up to date by
+       updateHubs instead. partitionObjects and distributeObjects set
+       the hubs up again afterwards.
+       - must be called on all processors simultaneously
+    */
+    void setupHubs();
+    bool isHub(GraphId id) const {return hubs.count(id);}
+    /**
+       Frontier-sparse step: send objects marked changed to the
+       processors caching them, receive changed ghosts in return, and
+       schedule in \c active the changed objects, along with locally
+       hosted objects linking to any changed object. Reverts to a full
+       exchange and schedule when the frontier exceeds \c denseThreshold.
+       - ghost objects' own links are not rebuilt
+       - must be called on all processors simultaneously
+    */
+    void advanceActive();
     void partitionObjects(); ///< partition
+    /**
+       Incremental checkpoint to files named \a prefix.<processor>.*
+       Only hosted objects whose version has changed since the
+       previous checkpoint are written, along with the ids of objects
+       no longer hosted, each processor writing its own file. Every
+       \c compactInterval checkpoints, all hosted objects are written
+       as a new base, and older files are removed.
+       - objects changed other than through markChanged must call
+         object::touch() to be saved. Changes to their links alone
+         are detected
+       - must be called on all processors simultaneously
+    */
+    void checkpoint(const std::string& prefix);
+    /// checkpoints between full base checkpoints. Must be the same on all processors
+    unsigned compactInterval=10;
+    /**
+       Record a trace to files named \a prefix.<processor>.trace, for
+       offline scaling prediction by trace_predict. The hosted objects
+       are listed with their weights, serialised sizes and neighbours.
+       Then each exchange (prepareNeighbours, advanceActive or
+       partitionObjects) is recorded, with the computation time since
+       the previous exchange, the time spent in the exchange, and the
+       size and source of each message received.
+       - must be called on all processors simultaneously
+    */
+    void startTrace(const std::string& prefix);
+    /// stop recording, and close the trace file
+    void stopTrace();
+
+    /**
+       memory used on this processor by each graphcode structure,
+       along with the resident set size of the process, and its peak
+       during each kind of collective phase (halo, active, partition,
+       distribute, ...) while \c trackMemoryPhases was set. Walks the
+       object table, so costs time proportional to its size.
+    */
+    virtual MemoryUsage memoryUsage() const;
+    /**
+       sample the resident set size at the start and end of every
+       collective phase, for MemoryUsage::phasePeak. Each sample costs
+       a read of /proc/self/statm and a getrusage call, so is off by
+       default.
+    */
+    bool trackMemoryPhases=false;
+    /**
+       memoryUsage of each processor, indexed by processor
+       - must be called on all processors simultaneously
+    */
+    vector<MemoryUsage> memoryUsageByRank() const;
+    /// processor hosting object \a id after loading an edge list
+    static unsigned loadOwner(GraphId id) {return id%nprocs();}
+    /**
+       Read this processor's share of a text edge list file, and
+       shuffle the edges to the processors hosting them (see
+       loadOwner()) in batches of about \a batchBytes of input.
+       - each line holds a "from to" pair of ids, separated by
+         whitespace or a comma. Further columns are ignored, as are lines
+         starting with \c # or \c %
+       - \a undirected means each edge links in both directions
+       - returns the links of each object hosted here, including
+         objects with no outgoing links
+       - must be called on all processors simultaneously
+    */
+    std::unordered_map<GraphId,vector<GraphId> > readEdgeList
+    (const std::string& filename, bool undirected=true, size_t batchBytes=1<<24);
+    /**
+       if true, partitionObjects weights each link by the bytes
+       expected to cross it per exchange - the serialised size of the
+       object linked to, times the fraction of past exchanges shipping
+       it - in place of object::edgeWeight()
+    */
+    bool volumeEdgeWeights=false;
+    /// total ghost bytes per full exchange predicted for the current partition, set by partitionObjects
+    double predictedHaloVolume=0;
+    /// mean total ghost bytes per exchange measured under the previous partition, set by partitionObjects
+    double previousHaloVolume=0;
+    /// mean total ghost bytes received per exchange since the last partitionObjects
+    double measuredHaloVolume() const;
+    /// total ghost bytes a full exchange would ship under the current request plan
+    double predictHaloVolume();
+    /**
+       relative capacity of each processor, used to size its share of
+       each partitioning constraint. Empty means equal shares.
+    */
+    vector<float> capacity;
+    /**
+       allowed load imbalance of each partitioning constraint. The
+       last entry applies to any further constraints; empty means 1.05.
+    */
+    vector<float> imbalanceTolerance;
+    /// set \c capacity from each processor's \a throughput
+    void setCapacity(double throughput);
+    /**
+       set \c capacity by timing \a kernel, which should perform the
+       same representative amount of work on each processor. The best
+       of \a repetitions runs is used.
+    */
+    template <class F>
+    void calibrateCapacity(F kernel, unsigned repetitions=3)
+    {
+      double best=std::numeric_limits<double>::max();
+      for (unsigned i=0; i<repetitions; i++)
+        {
+          auto start=std::chrono::steady_clock::now();
+          kernel();
+          best=std::min(best, std::chrono::duration<double>
+                        (std::chrono::steady_clock::now()-start).count());
+        }
+      setCapacity(1/std::max(best,std::numeric_limits<double>::min()));
+    }
+
+    /**
+       Frontier-sparse exchange of per-object values, for algorithms
+       whose state is held outside the objects themselves.
+       - \a changed lists locally hosted objects whose entry in \a values has changed
+       - only those entries are sent, and only to processors caching the object
+       - on return, entries for ghost objects are up to date
+       - returns the ids of the ghost entries updated
+       - must be called on all processors simultaneously
+    */
+    template <class V>
+    vector<GraphId> exchangeValues(const vector<GraphId>& changed, std::unordered_map<GraphId,V>& values)
+    {
+      vector<GraphId> updated;
+#ifdef MPI_SUPPORT
+      if (nprocs()==1) return updated;
+      if (rec_req.size()!=nprocs()) updateRequests();
+      MPIbuf_array sendbuf(nprocs());
+      for (auto id: changed)
+        {
+          auto sub=subscribers.find(id);
+          if (sub==subscribers.end()) continue; /* not a boundary object */
+          auto& v=values[id];
+          for (auto proc: sub->second)
+            sendbuf[proc] << id << v;
+        }
+      /* only processors sharing a boundary exchange messages */
+      tag++;
+      unsigned nRecv=0;
+      for (unsigned proc=0; proc<nprocs(); proc++)
+        {
+          if (!rec_req[proc].empty()) sendbuf[proc].isend(proc,tag);
+          if (!requests[proc].empty()) nRecv++;
+        }
+      for (unsigned i=0; i<nRecv; i++)
+        {
+          MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+          while (b.pos()<b.size())
+            {
+              GraphId id;
+              b>>id;
+              b>>values[id];
+              updated.push_back(id);
+            }
+        }
+#endif
+      return updated;
+    }
+
+    /**
+       Asynchronous (non bulk synchronous) execution. Locally hosted
+       objects are swept repeatedly by \a kernel, which should return
+       true if it changed the object it was passed. Changed boundary
+       objects are sent to the processors caching them as soon as a
+       sweep completes, and ghost updates are applied between sweeps as
+       they arrive, so fast processors are never held up by slow ones.
+       - \a kernel has signature bool(ObjRef&). Objects it reports
+         changed are touched
+       - \a maxSweeps limits the number of local sweeps on each processor
+       - returns the number of local sweeps performed
+       - must be called on all processors simultaneously
+       - convergence is the kernel's business: it should only report a
+         change when the update exceeds its tolerance
+    */
+    template <class F>
+    unsigned asyncIterate(F kernel, unsigned maxSweeps=~0U)
+    {
+      beginAsync();
+      vector<GraphId> changed;
+      unsigned sweeps=0;
+      bool quiescent=false;
+      do
+        {
+          bool updated=asyncReceive()>0;
+          if (sweeps<maxSweeps && (!quiescent || updated))
+            {
+              changed.clear();
+              for (auto& i: *this)
+                if (kernel(i))
+                  {
+                    i->touch();
+                    changed.push_back(i.id());
+                  }
+              sweeps++;
+              asyncSend(changed);
+              quiescent=changed.empty();
+            }
+          else if (sweeps>=maxSweeps)
+            quiescent=true;
+        }
+      while (!asyncTerminated(quiescent));
+      endAsync();
+      return sweeps;
+    }
+
+    /* lower level interface to asynchronous execution, used by asyncIterate */
+    /// start an asynchronous phase, establishing the neighbour plan. Collective.
+    void beginAsync();
+    /// send locally hosted objects \a changed to processors caching them
+    void asyncSend(const vector<GraphId>& changed);
+    /// apply any ghost updates that have arrived. Returns number of messages processed
+    unsigned asyncReceive();
+    /**
+       distributed termination detection. Returns true on all
+       processors once all processors are \a quiescent, and no
+       messages are in flight. Must be called repeatedly until true.
+    */
+    bool asyncTerminated(bool quiescent);
+    /// finish an asynchronous phase. Collective.
+    void endAsync();
+
+    /**
+       combine \a x across all processors with \a combine, by
+       recursive doubling. \a combine must be associative and
+       commutative, and V serialisable. Collective.
+    */
+    template <class V, class C>
+    V allCombine(V x, C combine)
+    {
+#ifdef MPI_SUPPORT
+      int n=nprocs(), me=myid();
+      if (n==1) return x;
+      tag++;
+      auto exchange=[&](int partner) {
+        MPIbuf out, in;
+        out<<x;
+        out.isend(partner,tag);
+        V y;
+        in.get(partner,tag)>>y;
+        out.wait();
+        /* combine in rank order, so all processors agree exactly */
+        x = partner<me? combine(y,x): combine(x,y);
+      };
+      /* fold processors in excess of a power of 2 into their neighbours */
+      int pof2=1;
+      while (2*pof2<=n) pof2*=2;
+      int rem=n-pof2, newRank;
+      if (me<2*rem)
+        {
+          if (me%2==0)
+            {
+              MPIbuf b; b<<x;
+              b.send(me+1,tag);
+              newRank=-1;
+            }
+          else
+            {
+              V y;
+              MPIbuf().get(me-1,tag)>>y;
+              x=combine(y,x);
+              newRank=me/2;
+            }
+        }
+      else
+        newRank=me-rem;
+
+      if (newRank>=0)
+        for (int mask=1; mask<pof2; mask<<=1)
+          {
+            int partner=newRank^mask;
+            exchange(partner<rem? 2*partner+1: partner+rem);
+          }
+
+      /* return result to the folded processors */
+      if (me<2*rem)
+        {
+          if (me%2==0)
+            MPIbuf().get(me+1,tag)>>x;
+          else
+            {
+              MPIbuf b; b<<x;
+              b.send(me-1,tag);
+            }
+        }
+#endif
+      return x;
+    }
   };
 
   /** Graph is a list of node refs stored on local processor, and has a
      map of object references (called objects) referring to the nodes.   */
 
+  template <class T> class GraphBuilder;
+
   template <class T>
   class Graph: public GraphBase
   {
     ObjectPtrBase& objectRef(GraphId id) override {return objects[id];}
+    ObjectPtrBase* findObject(GraphId id) override {
+      auto i=objects.find(id);
+      return i==objects.end()? nullptr: const_cast<ObjectPtr<T>*>(&*i);
+    }
     bool sane() const override {return objects.sane();}
     CLASSDESC_ACCESS(Graph);
+    friend class GraphBuilder<T>;
     graphcode::Allocator<T> cellAlloc;
     PtrList::Allocator ptrListAlloc;
+    /// locally hosted objects grouped into blocks, see buildBlocks()
+    Exclude<vector<ObjRef> > blockOrder;
+    /// end of each block in \c blockOrder
+    Exclude<vector<size_t> > blockEnd;
   public:
     using Cell=T;
     using OMapAllocator=graphcode::Allocator<ObjectPtr<T>>;
@@ -464,9 +1440,168 @@ namespace graphcode
             assert(i);
             emplace_back(i);
           }
+        }
+      {
+        long n=objectRefs.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1024)
+#endif
+        for (long i=0; i<n; i++)
+          if (auto& o=objectRefs[i])
+            {
+              if (compressedAdjacency)
+                o->compressNeighbours();
+              else
+                o->expandNeighbours();
+            }
+      }
+      if (objects.size()>=bulkLinkThreshold)
+        bulkUpdatePtrLists(ptrListAlloc);
+      else
+        for (auto& i: objects)
           if (i) i->updatePtrList(objects,ptrListAlloc);
+      blockOrder.clear();
+      blockEnd.clear();
+      localIndexData=LocalIndex();
+      for (auto& r: relationState)
+        r.offsets.clear();
+    }
+
+    MemoryUsage memoryUsage() const override
+    {
+      auto r=GraphBase::memoryUsage();
+      /* each node holds an entry and a next pointer, and may cache its hash */
+      r.entries=objects.bucket_count()*sizeof(void*)+
+        objects.size()*(sizeof(ObjectPtr<T>)+2*sizeof(void*));
+      r.indices+=(blockOrder.capacity())*sizeof(ObjRef)+blockEnd.capacity()*sizeof(size_t);
+      return r;
+    }
+
+    /// approximate memory touched by a sweep over \a x, including its links
+    static size_t footprint(const ObjRef& x)
+    {return sizeof(T)+sizeof(ObjectPtrBase)+x->size()*(sizeof(ObjRef)+sizeof(GraphId));}
+
+    /// target footprint of each block, eg a share of L2 cache
+    size_t cacheBudget=256*1024;
+
+    /**
+       Group the locally hosted objects into blocks whose combined
+       footprint fits within \c cacheBudget, each grown breadth first
+       from a seed object so that it is well connected. Called by
+       forEachBlock when needed, and invalidated by rebuildPtrLists.
+    */
+    void buildBlocks()
+    {
+      blockOrder.clear();
+      blockEnd.clear();
+      std::unordered_set<GraphId> assigned;
+      for (auto& seed: *this)
+        {
+          if (!assigned.insert(seed.id()).second) continue;
+          size_t start=blockOrder.size(), bytes=footprint(seed);
+          blockOrder.push_back(seed);
+          /* blockOrder doubles as the breadth first queue */
+          for (size_t head=start; head<blockOrder.size(); head++)
+            for (auto& n: *blockOrder[head])
+              if (n.proc()==myid() && !assigned.count(n.id()) &&
+                  bytes+footprint(n)<=cacheBudget)
+                {
+                  assigned.insert(n.id());
+                  bytes+=footprint(n);
+                  blockOrder.push_back(n);
+                }
+          blockEnd.push_back(blockOrder.size());
         }
     }
+    /// number of blocks, building them if needed
+    size_t numBlocks()
+    {
+      if (blockEnd.empty()) buildBlocks();
+      return blockEnd.size();
+    }
+
+    /**
+       Apply \a kernel to every locally hosted object, one block at a
+       time, sweeping each block \a sweeps times before moving on to
+       the next, so that repeated sweeps are served from cache.
+       - \a kernel has signature void(ObjRef&)
+       - with sweeps>1, objects on a block boundary see neighbours in
+         other blocks at the values of their most recent sweep, which
+         suits relaxation kernels, but not kernels requiring every
+         object to advance in lockstep
+    */
+    template <class F> void forEachBlock(F kernel, unsigned sweeps=1)
+    {
+      if (blockEnd.empty()) buildBlocks();
+      size_t start=0;
+      for (auto end: blockEnd)
+        {
+          for (unsigned s=0; s<sweeps; s++)
+            for (size_t i=start; i<end; i++)
+              kernel(blockOrder[i]);
+          start=end;
+        }
+    }
+
+    /**
+       load a graph from a text edge list in parallel, without
+       gathering it on any one processor (see
+       GraphBase::readEdgeList). Hosted objects are created with their
+       links, and default constructed objects stand in for remote
+       neighbours, ready for prepareNeighbours.
+       - must be called on all processors simultaneously
+    */
+    void loadEdgeList(const std::string& filename, bool undirected=true)
+    {
+      auto links=readEdgeList(filename,undirected);
+      for (auto& l: links)
+        {
+          ObjRef o=insertObject(l.first);
+          o.proc(myid());
+          o->neighbours.swap(l.second);
+        }
+      for (auto& l: links)
+        objects[l.first]->forEachNeighbourId([&](GraphId n) {
+          if (objects.find(n)==objects.end())
+            insertObject(n).proc(loadOwner(n));
+        });
+      rec_req.clear();
+      rebuildPtrLists();
+    }
+
+    /**
+       restore the state saved by the most recent checkpoint() to \a
+       prefix completed on all processors, by replaying its base
+       checkpoint followed by the deltas. Ghosts are left default
+       constructed, ready for prepareNeighbours.
+       - must be called on the same number of processors as wrote the checkpoint
+       - must be called on all processors simultaneously
+    */
+    void restoreCheckpoint(const std::string& prefix)
+    {
+      objects.clear();
+      replayCheckpoint(prefix);
+      vector<GraphId> removed;
+      for (auto& i: objects)
+        if (!i) removed.push_back(i.id());
+      for (auto id: removed)
+        objects.erase(id);
+      /* look up the hosts of remote neighbours */
+      std::unordered_set<GraphId> remote;
+      vector<GraphId> hosted;
+      for (auto& i: objects)
+        {
+          hosted.push_back(i.id());
+          i->forEachNeighbourId([&](GraphId n) {
+              if (!objects.count(n))
+                remote.insert(n);
+            });
+        }
+      for (auto& h: lookupHosts(hosted,remote))
+        insertObject(h.first).proc(h.second);
+      rec_req.clear();
+      rebuildPtrLists();
+    }
 
     /**
        distribute objects from proc 0 according to partitioning set in the 
@@ -474,11 +1609,34 @@ namespace graphcode
     */
     void distributeObjects()
     {
+      memoryPhaseBegin("distribute");
+      bool hadHubs=!hubs.empty();
 #ifdef MPI_SUPPORT
+      if (hadHubs)
+        {
+          /* mirrors hold only some of their hub's links, so masters
+             first return the full hubs to processor 0 */
+          MPIbuf full;
+          for (auto& h: hubs)
+            if (h.second.master==myid() && myid()>0)
+              full << h.first << objectRef(h.first);
+          full.gather(0);
+          if (myid()==0)
+            while (full.pos()<full.size())
+              {
+                GraphId id;
+                full >> id >> objectRef(id);
+              }
+        }
       rec_req.clear();
+      if (compressedAdjacency && myid()==0)
+        for (auto& i: objects)
+          if (i) i->compressNeighbours();
       MPIbuf() << objects << bcast(0) >> objects;
 #endif
       rebuildPtrLists();
+      if (hadHubs) setupHubs();
+      memoryPhaseEnd();
     }
 
     /** 
@@ -524,6 +1682,295 @@ namespace graphcode
         return insertObject(ObjectPtr<T>(id, std::allocate_shared<U>(cellAlloc,std::forward<Args>(args)...)));
       return *i;
     }
+
+    /**
+       add objects of type U in bulk, the i'th with id \a ids[i],
+       hosted on \a procs[i], and with neighbours
+       \a targets[offsets[i]..offsets[i+1]), then rebuild the
+       links. Table space is reserved up front, the objects are
+       allocated together in one block, constructed in parallel when
+       OpenMP is enabled, and each neighbour list is allocated once at
+       its final size.
+       - each object is constructed from \a args..., which should not throw
+       - \a offsets must be non-decreasing, ending within \a targets
+       - ids already present, or repeated in \a ids, keep their
+         first object, and no further object is constructed for them
+       - the block is released when all the objects in it are
+    */
+    template <class U=T, class... Args>
+    void bulkInsert(const vector<GraphId>& ids, const vector<unsigned>& procs,
+                    const vector<size_t>& offsets, const vector<GraphId>& targets,
+                    const Args&... args)
+    {
+      if (procs.size()!=ids.size() || offsets.size()!=ids.size()+1 || offsets.back()>targets.size())
+        throw std::runtime_error("inconsistent arguments to bulkInsert");
+      for (size_t i=0; i<ids.size(); i++)
+        if (offsets[i]>offsets[i+1])
+          throw std::runtime_error("bulkInsert offsets decrease at "+std::to_string(i));
+
+      /* indices of the ids to be constructed */
+      vector<size_t> fresh;
+      fresh.reserve(ids.size());
+      {
+        std::unordered_set<GraphId> seen;
+        for (size_t i=0; i<ids.size(); i++)
+          if (objects.find(ids[i])==objects.end() && seen.insert(ids[i]).second)
+            fresh.push_back(i);
+      }
+      size_t n=fresh.size();
+
+      struct Block
+      {
+        graphcode::Allocator<U> alloc;
+        U* cells;
+        size_t n;
+        Block(const graphcode::Allocator<U>& alloc, size_t n):
+          alloc(alloc), cells(this->alloc.allocate(n)), n(n) {}
+        ~Block() {
+          for (size_t i=0; i<n; i++) cells[i].~U();
+          alloc.deallocate(cells,n);
+        }
+      };
+      auto block=std::make_shared<Block>(cellAlloc,n);
+      U* cells=block->cells;
+      long nObjects=n;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1024)
+#endif
+      for (long i=0; i<nObjects; i++)
+        {
+          auto c=new(cells+i) U(args...);
+          size_t j=fresh[i];
+          c->neighbours.assign(targets.begin()+offsets[j], targets.begin()+offsets[j+1]);
+        }
+
+      if (n) cells[0].type(); /* ensure type is registered */
+      objects.reserve(objects.size()+n);
+      for (size_t i=0; i<n; i++)
+        {
+          auto r=objects.emplace(ids[fresh[i]], std::shared_ptr<T>(block, cells+i));
+          const_cast<ObjectPtr<T>&>(*r.first).proc=procs[fresh[i]];
+        }
+      rec_req.clear();
+      rebuildPtrLists();
+    }
+
+    /**
+       apply \a map to each locally hosted object, and combine the
+       results with \a combine, which must be associative with
+       identity \a init. Threads reduce their share of objects
+       separately when OpenMP is enabled.
+    */
+    template <class M, class C, class V>
+    V localReduce(M map, C combine, V init)
+    {
+      V r=init;
+#ifdef _OPENMP
+#pragma omp parallel
+      {
+        V partial=init;
+#pragma omp for nowait
+        for (size_t i=0; i<size(); i++)
+          partial=combine(partial, map((*this)[i]));
+#pragma omp critical
+        r=combine(r,partial);
+      }
+#else
+      for (auto& i: *this)
+        r=combine(r,map(i));
+#endif
+      return r;
+    }
+
+    /**
+       Global reduction: applies \a map to each locally hosted \a T,
+       and combines the results with \a combine thread locally, then
+       per processor, then across processors. The result is returned
+       on all processors.
+       - \a combine must be associative and commutative, with identity \a init
+       - V must be serialisable
+       - must be called on all processors simultaneously
+    */
+    template <class M, class C, class V>
+    V reduce(M map, C combine, V init)
+    {
+      auto r=localReduce([&](const ObjRef& i) {return map(cell(i));},combine,init);
+      return allCombine(r,combine);
+    }
+
+    /* built in reductions over the values of \a map applied to each
+       T. The i prefixed variants are nonblocking, returning a
+       Reduction handle. All must be called on all processors
+       simultaneously */
+    template <class M> using Value=typename std::decay<decltype(std::declval<M>()(std::declval<const T&>()))>::type;
+    /// object referred to by \a i, read only
+    static const T& cell(const ObjRef& i)
+    {return *static_cast<const object&>(*i).template as<T>();}
+
+    /**
+       Update hubs (see setupHubs) by gathering from their links: each
+       processor combines \a gather(hub,neighbour) over the hub's
+       neighbours it hosts, the hub's master combines those partial
+       results, and then \a apply(hub,total) updates the master and
+       each mirror of the hub, so only the combined result is sent.
+       - \a gather is passed the hub and neighbour read only
+       - \a init must be an identity of \a combine
+       - \a apply must depend only on the hub and \a total, and the
+         hub is touched afterwards
+       - hubs should be updated only this way, as ghosts of their
+         neighbours are not fetched to the master
+       - must be called on all processors simultaneously
+    */
+    template <class A, class Gather, class Combine, class Apply>
+    void updateHubs(Gather gather, Combine combine, Apply apply, const A& init=A())
+    {
+      std::unordered_map<GraphId,A> totals;
+      for (auto& h: hubs)
+        if (h.second.master==myid() || h.second.mirrored)
+          {
+            auto& hub=objectRef(h.first);
+            if (!hub) continue;
+            A a=init;
+            for (auto& n: *hub)
+              if (n.proc()==myid())
+                a=combine(a,gather(cell(hub),cell(n)));
+            totals.emplace(h.first,a);
+          }
+#ifdef MPI_SUPPORT
+      if (nprocs()>1)
+        {
+          /* partial results to the masters */
+          tag++;
+          MPIbuf_array sendbuf(nprocs());
+          for (auto& t: totals)
+            {
+              unsigned master=hubs[t.first].master;
+              if (master!=myid())
+                sendbuf[master] << t.first << t.second;
+            }
+          for (unsigned proc=0; proc<nprocs(); proc++)
+            if (proc!=myid()) sendbuf[proc].isend(proc,tag);
+          for (unsigned p=0; p<nprocs()-1; p++)
+            {
+              MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+              while (b.pos()<b.size())
+                {
+                  GraphId id; A a;
+                  b >> id >> a;
+                  auto& t=totals[id];
+                  t=combine(t,a);
+                }
+            }
+
+          /* combined results back to the mirrors */
+          tag++;
+          MPIbuf_array scatter(nprocs());
+          for (auto& h: hubs)
+            if (h.second.master==myid())
+              for (auto proc: h.second.mirrors)
+                scatter[proc] << h.first << totals[h.first];
+          for (unsigned proc=0; proc<nprocs(); proc++)
+            if (proc!=myid()) scatter[proc].isend(proc,tag);
+          for (unsigned p=0; p<nprocs()-1; p++)
+            {
+              MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+              while (b.pos()<b.size())
+                {
+                  GraphId id;
+                  b >> id >> totals[id];
+                }
+            }
+        }
+#endif
+      for (auto& t: totals)
+        {
+          auto& hub=objectRef(t.first);
+          apply(*hub->template as<T>(),t.second);
+          hub->touch();
+        }
+    }
+
+    template <class M> Reduction<Value<M>> isum(M map)
+    {
+      using V=Value<M>;
+      return Reduction<V>
+        (localReduce([&](const ObjRef& i) {return map(cell(i));},
+                     [](V x, V y) {return x+y;}, V()), ReduceOp::sum);
+    }
+    template <class M> Value<M> sum(M map) {return isum(map).wait();}
+
+    template <class M> Reduction<Value<M>> imin(M map)
+    {
+      using V=Value<M>;
+      return Reduction<V>
+        (localReduce([&](const ObjRef& i) {return map(cell(i));},
+                     [](V x, V y) {return std::min(x,y);}, std::numeric_limits<V>::max()),
+         ReduceOp::min);
+    }
+    template <class M> Value<M> min(M map) {return imin(map).wait();}
+
+    template <class M> Reduction<Value<M>> imax(M map)
+    {
+      using V=Value<M>;
+      return Reduction<V>
+        (localReduce([&](const ObjRef& i) {return map(cell(i));},
+                     [](V x, V y) {return std::max(x,y);}, std::numeric_limits<V>::lowest()),
+         ReduceOp::max);
+    }
+    template <class M> Value<M> max(M map) {return imax(map).wait();}
+
+    /// location of the maximum value of \a map. Ties go to the smallest id
+    template <class M> Reduction<MaxLoc> iargmax(M map)
+    {
+      return Reduction<MaxLoc>
+        (localReduce([&](const ObjRef& i) {return MaxLoc(map(cell(i)),i.id());},
+                     [](const MaxLoc& x, const MaxLoc& y) {return x.combine(y);}, MaxLoc()),
+         ReduceOp::maxLoc);
+    }
+    template <class M> MaxLoc argmax(M map) {return iargmax(map).wait();}
+
+    /**
+       histogram of \a map's values, in \a nBins equal bins over
+       [\a lo,\a hi). Values outside the range, including infinities,
+       are counted in the end bins. NaNs are not counted.
+    */
+    template <class M>
+    Reduction<vector<unsigned long>> ihistogram(M map, double lo, double hi, unsigned nBins)
+    {
+      vector<unsigned long> counts(nBins);
+      double scale=nBins/(hi-lo);
+      /* clamp before converting to an integer, as out of range
+         conversions are undefined. Returns -1 for NaN */
+      auto bin=[&](const ObjRef& i)->long {
+        double x=(map(cell(i))-lo)*scale;
+        if (std::isnan(x)) return -1;
+        return x<0? 0: x>=nBins? long(nBins)-1: long(x);
+      };
+#ifdef _OPENMP
+#pragma omp parallel
+      {
+        vector<unsigned long> partial(nBins);
+#pragma omp for nowait
+        for (size_t i=0; i<size(); i++)
+          {
+            long b=bin((*this)[i]);
+            if (b>=0) partial[b]++;
+          }
+#pragma omp critical
+        for (unsigned b=0; b<nBins; b++) counts[b]+=partial[b];
+      }
+#else
+      for (auto& i: *this)
+        {
+          long b=bin(i);
+          if (b>=0) counts[b]++;
+        }
+#endif
+      return Reduction<vector<unsigned long>>(counts,ReduceOp::sum);
+    }
+    template <class M>
+    vector<unsigned long> histogram(M map, double lo, double hi, unsigned nBins)
+    {return ihistogram(map,lo,hi,nBins).wait();}
   };		   
 }
   
@@ -533,6 +1980,12 @@ namespace graphcode
 #pragma omit RESTProcess graphcode::ObjectPtrBase
 #pragma omit pack graphcode::OMap
 #pragma omit unpack graphcode::OMap
+#pragma omit pack graphcode::LocalIndex
+#pragma omit unpack graphcode::LocalIndex
+#pragma omit RESTProcess graphcode::LocalIndex
+#pragma omit pack graphcode::GraphBase::Links
+#pragma omit unpack graphcode::GraphBase::Links
+#pragma omit RESTProcess graphcode::GraphBase::Links
 #endif
 
 namespace classdesc_access
@@ -0,0 +1,122 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  void GraphBase::setupHubs()
+  {
+    hubs.clear();
+    rec_req.clear(); /* hubs are left out of the halo plan */
+    vector<GraphId> local;
+    if (hubDegree)
+      for (auto& i: *this)
+        if (i->neighbourCount()>=hubDegree)
+          {
+            local.push_back(i.id());
+            hubs[i.id()].master=myid();
+          }
+#ifdef MPI_SUPPORT
+    if (nprocs()>1)
+      {
+        /* every processor learns the hubs and their masters */
+        MPIbuf found;
+        for (auto id: local)
+          found << myid() << id;
+        found.gather(0);
+        found.bcast(0);
+        while (found.pos() < found.size())
+          {
+            unsigned proc; GraphId id;
+            found >> proc >> id;
+            hubs[id].master=proc;
+          }
+
+        /* masters learn which processors host objects linking to their hubs */
+        tag++;
+        MPIbuf_array sendbuf(nprocs());
+        std::unordered_set<GraphId> linked;
+        for (auto& i: *this)
+          if (!isHub(i.id()))
+            i->forEachNeighbourId([&](GraphId n) {
+                auto h=hubs.find(n);
+                if (h!=hubs.end() && h->second.master!=myid() && linked.insert(n).second)
+                  sendbuf[h->second.master] << n;
+              });
+        for (unsigned proc=0; proc<nprocs(); proc++)
+          if (proc!=myid()) sendbuf[proc].isend(proc,tag);
+        vector<std::set<unsigned> > mirrors(local.size());
+        std::unordered_map<GraphId,size_t> localIdx;
+        for (size_t i=0; i<local.size(); i++)
+          localIdx[local[i]]=i;
+        for (unsigned p=0; p<nprocs()-1; p++)
+          {
+            MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+            while (b.pos()<b.size())
+              {
+                GraphId id;
+                b >> id;
+                mirrors[localIdx[id]].insert(b.proc);
+              }
+          }
+
+        /* each mirror starts from the master's state, with just the
+           links to objects hosted on the mirror's processor */
+        tag++;
+        MPIbuf_array mirrorbuf(nprocs());
+        for (size_t i=0; i<local.size(); i++)
+          {
+            auto& hub=objectRef(local[i]);
+            std::map<unsigned,vector<GraphId> > links;
+            hub->forEachNeighbourId([&](GraphId n) {
+                unsigned proc=objectRef(n).proc;
+                if (proc!=myid())
+                  links[proc].push_back(n);
+              });
+            for (auto& l: links)
+              mirrors[i].insert(l.first);
+            /* the hub's links are swapped out while it is packed for each mirror */
+            vector<GraphId> own;
+            CompressedIds compressed;
+            own.swap(hub->neighbours);
+            std::swap(compressed,hub->compressedNeighbours);
+            for (auto proc: mirrors[i])
+              {
+                hub->neighbours.swap(links[proc]);
+                mirrorbuf[proc] << hub.id() << hub;
+                hub->neighbours.swap(links[proc]);
+              }
+            own.swap(hub->neighbours);
+            std::swap(compressed,hub->compressedNeighbours);
+            hubs[local[i]].mirrors.assign(mirrors[i].begin(),mirrors[i].end());
+          }
+        for (unsigned proc=0; proc<nprocs(); proc++)
+          if (proc!=myid()) mirrorbuf[proc].isend(proc,tag);
+        for (unsigned p=0; p<nprocs()-1; p++)
+          {
+            MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+            while (b.pos()<b.size())
+              {
+                GraphId id;
+                b >> id;
+                auto& mirror=objectRef(id);
+                b >> mirror;
+                mirror.proc=b.proc;
+                hubs[id].mirrored=true;
+              }
+          }
+      }
+#endif /* MPI_SUPPORT */
+    rebuildPtrLists();
+  }
+}
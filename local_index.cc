@@ -0,0 +1,72 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <stdexcept>
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  const LocalIndex& GraphBase::localIndex()
+  {
+    typedef LocalIndex::Index Index;
+    auto& x=localIndexData;
+    if (x.stale)
+      {
+        /* ghosts are replaced on receipt, so look them up afresh */
+        for (Index i=x.hosted; i<x.size(); i++)
+          x.cells[i]=objectRef(x.ids[i]).get();
+        x.stale=false;
+      }
+    if (!x.empty()) return x;
+
+    /* hosted objects first, then the ghosts */
+    vector<ObjRef> order(begin(),end());
+    for (auto& i: objectRefs)
+      if (i && i.proc()!=myid())
+        order.push_back(i);
+    if (order.size()>std::numeric_limits<Index>::max())
+      throw std::runtime_error("too many objects for a 32 bit local index");
+
+    std::unordered_map<GraphId,Index> index;
+    index.reserve(order.size());
+    x.hosted=size();
+    x.cells.reserve(order.size());
+    x.ids.reserve(order.size());
+    x.offsets.assign(1,0);
+    x.offsets.reserve(order.size()+1);
+    size_t nLinks=0;
+    for (auto& i: order)
+      {
+        index.emplace(i.id(),x.cells.size());
+        x.cells.push_back(i.payload->get());
+        x.ids.push_back(i.id());
+        nLinks+=i->size();
+        if (nLinks>std::numeric_limits<Index>::max())
+          throw std::runtime_error("too many links for a 32 bit local index");
+        x.offsets.push_back(nLinks);
+      }
+
+    /* links only refer to objects present, all of which are indexed */
+    x.links.resize(nLinks);
+    long n=order.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1024)
+#endif
+    for (long i=0; i<n; i++)
+      {
+        Index j=x.offsets[i];
+        for (auto& l: *order[i])
+          x.links[j++]=index.find(l.id())->second;
+      }
+    return x;
+  }
+}
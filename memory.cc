@@ -0,0 +1,149 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <cstdio>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  namespace
+  {
+    template <class V> size_t bytes(const V& x)
+    {return x.capacity()*sizeof(typename V::value_type);}
+
+    template <class V> size_t nestedBytes(const vector<V>& x)
+    {
+      size_t r=bytes(x);
+      for (auto& i: x) r+=bytes(i);
+      return r;
+    }
+
+    /// node layout is implementation defined, so assume an entry, a next pointer and a cached hash
+    template <class M> size_t hashBytes(const M& x)
+    {return x.bucket_count()*sizeof(void*)+x.size()*(sizeof(typename M::value_type)+2*sizeof(void*));}
+
+    template <class K, class V> size_t mapOfVectorsBytes(const std::unordered_map<K,vector<V> >& x)
+    {
+      size_t r=hashBytes(x);
+      for (auto& i: x) r+=bytes(i.second);
+      return r;
+    }
+
+    /// current resident set size, or 0 where it cannot be obtained cheaply
+    size_t residentBytes()
+    {
+#ifdef __linux__
+      FILE* f=fopen("/proc/self/statm","r");
+      if (!f) return 0;
+      unsigned long size=0, resident=0;
+      int n=fscanf(f,"%lu %lu",&size,&resident);
+      fclose(f);
+      return n==2? resident*sysconf(_SC_PAGESIZE): 0;
+#else
+      return 0;
+#endif
+    }
+
+    size_t peakResidentBytes()
+    {
+      struct rusage u;
+      if (getrusage(RUSAGE_SELF,&u)) return 0;
+#ifdef __APPLE__
+      return u.ru_maxrss;
+#else
+      return u.ru_maxrss*size_t(1024);
+#endif
+    }
+  }
+
+  void GraphBase::memoryPhaseBegin(const char* kind)
+  {
+    if (!trackMemoryPhases) return;
+    memoryPhases.push_back({kind,residentBytes(),peakResidentBytes()});
+  }
+
+  void GraphBase::memoryPhaseEnd()
+  {
+    /* phases begun before trackMemoryPhases was cleared are still closed */
+    if (memoryPhases.empty()) return;
+    auto p=memoryPhases.back();
+    memoryPhases.pop_back();
+    size_t peak=std::max(p.resident,residentBytes());
+    /* transient buffers freed before the end are only seen if they raised the high water mark */
+    size_t highWater=peakResidentBytes();
+    if (highWater>p.peakResident) peak=std::max(peak,highWater);
+    auto& m=memoryPeaks[p.kind];
+    m=std::max(m,peak);
+  }
+
+  MemoryUsage GraphBase::memoryUsage() const
+  {
+    MemoryUsage r;
+    for (auto& i: objectRefs)
+      {
+        if (!i) continue;
+        (i.proc()==myid()? r.hosted: r.ghosts)+=i->objectSize();
+        r.neighbours+=bytes(i->neighbours)+bytes(i->compressedNeighbours.data)+
+          nestedBytes(i->relations);
+        r.ptrLists+=bytes(*i);
+      }
+    r.entries=objectRefs.size()*(sizeof(ObjectPtrBase)+2*sizeof(void*));
+    r.objectRefs=bytes(objectRefs)+bytes(static_cast<const PtrList&>(*this));
+
+    r.plan=nestedBytes(rec_req)+nestedBytes(requests)+mapOfVectorsBytes(subscribers)+
+      mapOfVectorsBytes(dependants)+bytes(haloOrder)+bytes(layerEnd)+nestedBytes(sentVersions);
+    for (auto& s: relationState)
+      {
+        r.plan+=nestedBytes(s.rec_req)+nestedBytes(s.requests);
+        r.indices+=bytes(s.offsets)+bytes(s.links);
+      }
+    auto& x=localIndexData;
+    r.indices+=bytes(x.cells)+bytes(x.ids)+bytes(x.offsets)+bytes(x.links);
+    for (auto& h: hubs)
+      r.indices+=sizeof(h)+2*sizeof(void*)+bytes(h.second.mirrors);
+
+    r.resident=residentBytes();
+    /* the high water mark is updated lazily, so may trail the current size */
+    r.peakResident=std::max(peakResidentBytes(),r.resident);
+    r.phasePeak=memoryPeaks;
+    return r;
+  }
+
+  vector<MemoryUsage> GraphBase::memoryUsageByRank() const
+  {
+    vector<MemoryUsage> r{memoryUsage()};
+#ifdef MPI_SUPPORT
+    MPIbuf b;
+    /* fields are packed individually, as descriptors of MemoryUsage
+       are not available within the library */
+    auto& m=r[0];
+    b << myid() << m.hosted << m.ghosts << m.entries << m.objectRefs << m.neighbours
+      << m.ptrLists << m.plan << m.indices << m.resident << m.peakResident << m.phasePeak;
+    b.gather(0);
+    b.bcast(0);
+    r.resize(nprocs());
+    while (b.pos() < b.size())
+      {
+        unsigned proc;
+        b >> proc;
+        auto& m=r[proc];
+        b >> m.hosted >> m.ghosts >> m.entries >> m.objectRefs >> m.neighbours
+          >> m.ptrLists >> m.plan >> m.indices >> m.resident >> m.peakResident >> m.phasePeak;
+      }
+#endif
+    return r;
+  }
+}
@@ -0,0 +1,155 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/**
+   Pregel style message passing between objects of a Graph. Kernels
+   send small messages to objects by id, rather than fetching whole
+   neighbouring objects with prepareNeighbours. Messages to the same
+   object are combined on the sending processor before delivery, so
+   at most one message per object crosses between any two
+   processors, and all messages for a processor are sent in one
+   batch.
+*/
+
+#ifndef GRAPHCODE_MESSAGES_H
+#define GRAPHCODE_MESSAGES_H
+
+#include "graphcode.h"
+#include <functional>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace graphcode
+{
+  template <class M, class Combine=std::plus<M> >
+  class Messages
+  {
+    GraphBase& graph;
+    Combine combine;
+    typedef std::unordered_map<GraphId,M> Box;
+    /**
+       messages not yet delivered, by sending thread, processor
+       hosting the target, then target. The last is shared by threads
+       not numbered when constructed, and those of nested regions
+    */
+    vector<vector<Box> > outbox;
+    /// messages delivered to each locally hosted object
+    std::unordered_map<GraphId,vector<M> > inbox;
+    /// outbox of the calling thread. The last, shared, outbox is used by any thread outside the first team
+    unsigned thread() const
+    {
+#ifdef _OPENMP
+      if (omp_get_level()<=1)
+        return std::min<unsigned>(omp_get_thread_num(),outbox.size()-1);
+      return outbox.size()-1;
+#else
+      return 0;
+#endif
+    }
+    void add(Box& box, GraphId target, const M& msg)
+    {
+      auto i=box.emplace(target,msg);
+      if (!i.second) i.first->second=combine(i.first->second,msg);
+    }
+  public:
+    /// messages between objects of \a graph, combined by \a combine, which must be associative
+    explicit Messages(GraphBase& graph, Combine combine=Combine()):
+      graph(graph), combine(combine)
+    {
+#ifdef _OPENMP
+      outbox.resize(omp_get_max_threads()+1);
+#else
+      outbox.resize(1);
+#endif
+      for (auto& o: outbox) o.resize(nprocs());
+    }
+
+    /**
+       send \a msg to object \a target, combining it with any message
+       already sent to \a target since the last deliver(). May be
+       called from the threads of a parallel region at once.
+    */
+    void send(GraphId target, const M& msg)
+    {
+      auto o=graph.findObject(target);
+      if (!o) throw std::runtime_error("message sent to unknown object "+std::to_string(target));
+      unsigned t=thread();
+#ifdef _OPENMP
+      if (t+1==outbox.size())
+        {
+#pragma omp critical(graphcode_Messages)
+          add(outbox[t][o->proc],target,msg);
+          return;
+        }
+#endif
+      add(outbox[t][o->proc],target,msg);
+    }
+
+    /**
+       deliver the messages sent since the last call, replacing those
+       delivered previously
+       - must be called on all processors simultaneously, outside any parallel region
+    */
+    void deliver()
+    {
+      graph.traceExchangeBegin("messages");
+      inbox.clear();
+      /* each thread's messages are combined into the first thread's */
+      auto& out=outbox[0];
+      for (size_t t=1; t<outbox.size(); t++)
+        for (unsigned proc=0; proc<nprocs(); proc++)
+          {
+            for (auto& m: outbox[t][proc])
+              add(out[proc],m.first,m.second);
+            outbox[t][proc].clear();
+          }
+      for (auto& m: out[myid()])
+        inbox[m.first].push_back(std::move(m.second));
+      out[myid()].clear();
+#ifdef MPI_SUPPORT
+      if (nprocs()>1)
+        {
+          graph.tag++;
+          MPIbuf_array sendbuf(nprocs());
+          for (unsigned proc=0; proc<nprocs(); proc++)
+            {
+              if (proc==myid()) continue;
+              for (auto& m: out[proc])
+                sendbuf[proc] << m.first << m.second;
+              out[proc].clear();
+              sendbuf[proc].isend(proc,graph.tag);
+            }
+          for (unsigned p=0; p<nprocs()-1; p++)
+            {
+              MPIbuf b; b.get(MPI_ANY_SOURCE,graph.tag);
+              graph.traceMessage(b.proc,b.size());
+              while (b.pos()<b.size())
+                {
+                  GraphId id; M m;
+                  b >> id >> m;
+                  inbox[id].push_back(std::move(m));
+                }
+            }
+        }
+#endif
+      graph.traceExchangeEnd();
+    }
+
+    /// messages delivered to object \a id, one from each processor that sent it any
+    const vector<M>& operator[](GraphId id) const
+    {
+      static const vector<M> none;
+      auto i=inbox.find(id);
+      return i==inbox.end()? none: i->second;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+#if defined(MPI_SUPPORT) && defined(MPI_VERSION) && MPI_VERSION>=3
+#define NEIGHBOURHOOD_HALO
+#endif
+
+namespace graphcode
+{
+  /*
+     The processor graph is fixed by the request plan, so it is
+     created once, and all boundary objects are exchanged in a single
+     nonblocking neighbourhood collective, completed by
+     haloNeighbourhoodEnd().
+  */
+  struct GraphBase::NeighbourhoodState
+  {
+#ifdef NEIGHBOURHOOD_HALO
+    MPI_Comm comm=MPI_COMM_NULL;
+    /* processors we receive ghosts from, and send boundary objects to */
+    vector<int> sources, destinations;
+    vector<int> sendCounts, sendDispls, recvCounts, recvDispls;
+    pack_t sendbuf;
+    vector<char> recvbuf;
+    MPI_Request request=MPI_REQUEST_NULL;
+
+    NeighbourhoodState(const GraphBase& g)
+    {
+      for (unsigned proc=0; proc<nprocs(); proc++)
+        {
+          if (!g.requests[proc].empty()) sources.push_back(proc);
+          if (!g.rec_req[proc].empty()) destinations.push_back(proc);
+        }
+      MPI_Dist_graph_create_adjacent
+        (MPI_COMM_WORLD,sources.size(),sources.data(),MPI_UNWEIGHTED,
+         destinations.size(),destinations.data(),MPI_UNWEIGHTED,
+         MPI_INFO_NULL,0/* no reordering */,&comm);
+      sendCounts.resize(destinations.size());
+      sendDispls.resize(destinations.size());
+      recvCounts.resize(sources.size());
+      recvDispls.resize(sources.size());
+    }
+    ~NeighbourhoodState()
+    {
+      if (MPI_running())
+        {
+          if (request!=MPI_REQUEST_NULL) MPI_Wait(&request,MPI_STATUS_IGNORE);
+          MPI_Comm_free(&comm);
+        }
+    }
+#endif
+  };
+
+  void GraphBase::haloNeighbourhoodBegin()
+  {
+#ifdef NEIGHBOURHOOD_HALO
+    if (!neighbourhoodHalo) neighbourhoodHalo.reset(new NeighbourhoodState(*this));
+    NeighbourhoodState& s=*neighbourhoodHalo;
+
+    s.sendbuf.reseti();
+    for (size_t i=0; i<s.destinations.size(); i++)
+      {
+        s.sendDispls[i]=s.sendbuf.size();
+        for (auto id: rec_req[s.destinations[i]])
+          s.sendbuf << objectRef(id);
+        s.sendCounts[i]=s.sendbuf.size()-s.sendDispls[i];
+      }
+
+    MPI_Neighbor_alltoall(s.sendCounts.data(),1,MPI_INT,s.recvCounts.data(),1,MPI_INT,s.comm);
+    int total=0;
+    for (size_t i=0; i<s.sources.size(); i++)
+      {
+        s.recvDispls[i]=total;
+        total+=s.recvCounts[i];
+      }
+    s.recvbuf.resize(total);
+    MPI_Ineighbor_alltoallv(s.sendbuf.data(),s.sendCounts.data(),s.sendDispls.data(),MPI_CHAR,
+                            s.recvbuf.data(),s.recvCounts.data(),s.recvDispls.data(),MPI_CHAR,
+                            s.comm,&s.request);
+#else
+    haloTwoSided();
+#endif
+  }
+
+  void GraphBase::haloNeighbourhoodEnd()
+  {
+#ifdef NEIGHBOURHOOD_HALO
+    NeighbourhoodState& s=*neighbourhoodHalo;
+    MPI_Wait(&s.request,MPI_STATUS_IGNORE);
+    for (size_t i=0; i<s.sources.size(); i++)
+      {
+        haloReceived(s.sources[i],s.recvCounts[i]);
+        pack_t b;
+        b.packraw(s.recvbuf.data()+s.recvDispls[i],s.recvCounts[i]);
+        for (auto id: requests[s.sources[i]])
+          b>>objectRef(id);
+      }
+#endif
+  }
+}
@@ -9,6 +9,7 @@
 #include "graphcode.h"
 #include <utility>
 #include <map>
+#include <cmath>
 #include "classdesc_epilogue.h"
 #ifdef ECOLAB_LIB
 #include "ecolab_epilogue.h"
@@ -30,25 +31,76 @@ namespace graphcode
   };
 
 #ifdef MPI_SUPPORT
-  void checkAddReverseEdge(vector<vector<unsigned> >& nbrs, MPIbuf& b)
+  /* neighbours of each vertex, and the weight of the connecting edge */
+  typedef vector<map<unsigned,idx_t> > Adjacency;
+
+  /*
+    Links in either direction contribute to an edge's weight - the
+    largest contribution for user supplied weights, or their sum for
+    communication volumes, as each direction ships an object
+  */
+  void addEdgeWeight(idx_t& w, idx_t weight, bool sum)
+  {
+    w= sum? w+weight: std::max(w,weight);
+  }
+
+  void checkAddReverseEdge(Adjacency& nbrs, MPIbuf& b, bool sum)
     {
       pair<unsigned,unsigned> edge;
+      idx_t weight;
       while (b.pos()<b.size())
 	{
-	  b>>edge;
-	  vector<unsigned>::iterator begin=nbrs[edge.first].begin(),
-	    end=nbrs[edge.first].end();
-	  if (find(begin,end,edge.second)==end) /* edge not found, insert */
-	    nbrs[edge.first].push_back(edge.second);
+	  b>>edge>>weight;
+          /* insert edge if not found, and symmetrise its weight */
+          addEdgeWeight(nbrs[edge.first][edge.second],weight,sum);
 	}
     }
 #endif
 
+  void GraphBase::setCapacity(double throughput)
+  {
+#ifdef MPI_SUPPORT
+    capacity.resize(nprocs());
+    float c=throughput;
+    MPI_Allgather(&c,1,MPI_FLOAT,capacity.data(),1,MPI_FLOAT,MPI_COMM_WORLD);
+#else
+    capacity.assign(1,throughput);
+#endif
+  }
+
+  double GraphBase::measuredHaloVolume() const
+  {
+    unsigned long bytes=allReduce(traffic.bytes,ReduceOp::sum);
+    return traffic.rounds? double(bytes)/traffic.rounds: 0;
+  }
+
+  double GraphBase::predictHaloVolume()
+  {
+    double bytes=0;
+#ifdef MPI_SUPPORT
+    if (rec_req.size()!=nprocs()) updateRequests();
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      if (proc!=myid())
+        for (auto id: rec_req[proc])
+          {
+            pack_t b;
+            b << objectRef(id);
+            bytes+=b.size();
+          }
+#endif
+    return allReduce(bytes,ReduceOp::sum);
+  }
+
   void GraphBase::partitionObjects()
   {
+    traceExchangeBegin("partition");
 #if defined(MPI_SUPPORT) && defined(PARMETIS)
     rebuildPtrLists();
-    if (nprocs()==1) return;
+    if (nprocs()==1)
+      {
+        traceExchangeEnd();
+        return;
+      }
     prepareNeighbours(); /* used for computing edgeweights */
 
     unsigned i, j, nedges, nvertices=objectRefs.size();
@@ -70,26 +122,51 @@ namespace graphcode
     for (auto& pi: objectRefs)  
       pMap[pi.id()]+=counts[pi.proc()];
 
+    /* bytes expected to be shipped per exchange for each object, and its ghosts */
+    std::unordered_map<GraphId,double> volume;
+    if (volumeEdgeWeights)
+      {
+        vector<GraphId> local;
+        for (auto& p: *this)
+          {
+            pack_t b;
+            b << objectRef(p.id());
+            volume[p.id()]=b.size()*traffic.rate(p.id());
+            local.push_back(p.id());
+          }
+        exchangeValues(local,volume);
+      }
+
     /* construct a set of edges connected to each local vertex */
-    vector<vector<unsigned> > nbrs(nvertices);
+    Adjacency nbrs(nvertices);
     {
       MPIbuf_array edgedist(nprocs());    
       for (auto& p: *this)
 	for (auto& n: *p)
 	  {
 	    if (n.id()==p.id()) continue; /* ignore self-links */
-	    nbrs[pMap[p.id()]].push_back(pMap[n.id()]);
-	    edgedist[n.proc()] << std::make_pair(pMap[n.id()],pMap[p.id()]);
+            /* the links of hubs are cut by mirroring, costing at most
+               one mirror per processor, so they carry the least weight */
+            idx_t weight= isHub(p.id()) || isHub(n.id())? 1:
+              volumeEdgeWeights?
+              std::max(idx_t(1),idx_t(std::ceil(volume[n.id()]))):
+              p->edgeWeight(n);
+            addEdgeWeight(nbrs[pMap[p.id()]][pMap[n.id()]],weight,volumeEdgeWeights);
+	    edgedist[n.proc()] << std::make_pair(pMap[n.id()],pMap[p.id()]) << weight;
 	  }
 
       /* Ensure reverse edge is in graph (Metis requires graphs to be undirected */
       tag++;
       for (i=0; i<nprocs(); i++) if (i!=myid()) edgedist[i].isend(i,tag);
       /* process local list first */
-      checkAddReverseEdge(nbrs,edgedist[myid()]);
+      checkAddReverseEdge(nbrs,edgedist[myid()],volumeEdgeWeights);
       /* now get them from remote processors */
       for (i=0; i<nprocs()-1; i++)
-	checkAddReverseEdge(nbrs,MPIbuf().get(MPI_ANY_SOURCE,tag));
+        {
+          MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+          traceMessage(b.proc,b.size());
+          checkAddReverseEdge(nbrs,b,volumeEdgeWeights);
+        }
     }
 
     /* compute number of edges connected to vertices local to this processor */
@@ -98,7 +175,7 @@ namespace graphcode
       nedges+=nbrs[i].size();
 
     vector<idx_t> offsets(objectRefs.size()+1);
-    vector<idx_t> edges(nedges);
+    vector<idx_t> edges(nedges), eWgts(nedges);
     vector<idx_t> partitioning(size());
 
     /* fill adjacency arrays suitable for call to METIS */
@@ -107,32 +184,43 @@ namespace graphcode
     for (int i=counts[myid()]; i<counts[myid()+1]; i++)
       {
 	for (auto& j: nbrs[i])
-          edges[nedges++]=j;
+          {
+            edges[nedges]=j.first;
+            eWgts[nedges++]=j.second;
+          }
 	offsets[i-counts[myid()]+1]=nedges;
       }
 
-    int weightFlag=3, numFlag=0, nParts=nprocs(), edgeCut, nCon=1;
-    vector<float> tpWgts(nParts);
-    vector<idx_t> vWgts(size()), eWgts(nedges);
+    /* all objects must supply the same number of weights */
+    int nCon=1;
+    for (auto& p: *this)
+      nCon=std::max(nCon,int(p->weights().size()));
+    nCon=allReduce(nCon,ReduceOp::max);
+    vector<idx_t> vWgts(nCon*size());
     i=0;
-    for (auto& p: *this) vWgts[i++]=p->weight();
-    /* reverse pmap */
-    vector<GraphId> rpMap(nvertices); 			
-    for (auto& pi: objectRefs) 
-      rpMap[pMap[pi.id()]]=pi.id();
-    i=1, j=0;
-    for (auto p=begin(); p!=end(); p++, i++) 
-      for (auto otherNode=(*p)->begin(); j<unsigned(offsets[i]); ++j, ++otherNode)
-        {
-          eWgts[j]=(*p)->edgeWeight(**otherNode);
-        }
-    for (i=0; i<unsigned(nParts); i++) tpWgts[i]=1.0/nParts;
-    float ubvec[]={1.05};
+    for (auto& p: *this)
+      {
+        auto w=p->weights();
+        w.resize(nCon,0);
+        for (auto x: w) vWgts[i++]=x;
+      }
+
+    /* each processor's share of every constraint is proportional to its capacity */
+    int weightFlag=3, numFlag=0, nParts=nprocs(), edgeCut;
+    vector<float> tpWgts(nCon*nParts);
+    float totalCapacity=0;
+    if (capacity.size()==nprocs())
+      for (auto c: capacity) totalCapacity+=c;
+    for (i=0; i<unsigned(nParts); i++)
+      for (j=0; j<unsigned(nCon); j++)
+        tpWgts[i*nCon+j]= totalCapacity>0? capacity[i]/totalCapacity: 1.0/nParts;
+    vector<float> ubvec(imbalanceTolerance);
+    ubvec.resize(nCon, ubvec.empty()? 1.05: ubvec.back());
     int options[]={0,0,0,0,0}; /* for production */
     //int options[]={1,0xFF,15,0,0};  /* for debugging */
     MPI_Comm comm=MPI_COMM_WORLD;
     ParMETIS_V3_PartKway(counts.data(),offsets.data(),edges.data(),vWgts.data(),eWgts.data(),
-			&weightFlag,&numFlag,&nCon,&nParts,tpWgts.data(),ubvec,options,
+			&weightFlag,&numFlag,&nCon,&nParts,tpWgts.data(),ubvec.data(),options,
 			&edgeCut,partitioning.data(),&comm);
 
     /* prepare pins to be sent to remote processors */
@@ -182,6 +270,7 @@ namespace graphcode
     for (int i=0; i<nprocs()-1; i++)
       {
 	MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+        traceMessage(b.proc,b.size());
 	GraphId index;
 	while (b.pos()<b.size()) 
 	  {
@@ -201,7 +290,16 @@ namespace graphcode
         assert(proc<nprocs());
         objectRef(index).proc=proc;
       }
+    rebuildPtrLists();
+
+    /* compare the halo traffic measured under the old partition with that expected of the new */
+    previousHaloVolume=measuredHaloVolume();
+    traffic=HaloTraffic();
+    predictedHaloVolume=predictHaloVolume();
+    /* hubs may have moved, and their links with them */
+    if (!hubs.empty()) setupHubs();
 #endif /* MPI_SUPPORT */
     rebuildPtrLists();
+    traceExchangeEnd();
 };
 }
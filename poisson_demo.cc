@@ -8,10 +8,6 @@
 
 /* This is a simple demo of graphcode.  */
 
-extern void initr(unsigned long seed);
-extern unsigned long ibase(void);
-extern double drand(void);
-
 // we need to include mpi.h before iostream
 #ifdef MPI_SUPPORT
 #include <mpi.h>
@@ -23,6 +19,8 @@ extern double drand(void);
 #define MAP vmap
 #include "graphcode.h"
 #include "graphcode.cd"
+#include "random.h"
+#include "builder.h"
 using namespace graphcode;
 using namespace std;
 
@@ -51,7 +49,7 @@ class Von: public Graph<Cell>
 {
 public:
   void setup(int size);
-  void update();
+  void update(unsigned step);
   void print();
 };
 
@@ -59,20 +57,31 @@ void Von::setup(int size)
 {
   unsigned xprocs=(unsigned)sqrt(double(nprocs()));
   unsigned yprocs=nprocs()/xprocs;
-  int i, j;
   MakeId makeId(size);
-  for(j=0; j<size; j++)
-    for(i=0; i<size; i++)
+  /* rows of objects are constructed concurrently */
+  GraphBuilder<Cell> builder(*this);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(int j=0; j<size; j++)
+    for(int i=0; i<size; i++)
       {
-	ObjRef o=insertObject<>(makeId(i,j));
-        o.proc((i*xprocs) / size + (j*yprocs)/size*xprocs);
+	auto& o=builder.insertObject(makeId(i,j));
+        o.proc=(i*xprocs) / size + (j*yprocs)/size*xprocs;
         o->neighbours.push_back(makeId(i-1,j)); 
         o->neighbours.push_back(makeId(i+1,j)); 
         o->neighbours.push_back(makeId(i,j-1)); 
         o->neighbours.push_back(makeId(i,j+1)); 
       }
-
-  rebuildPtrLists();
+  builder.freeze();
+
+  /* initial values depend only on object id, not on the partitioning */
+  vector<GraphId> ids;
+  for (auto& i: objectRefs) ids.push_back(i.id());
+  vector<double> values(ids.size());
+  uniformBatch(ids.data(),ids.size(),values.data(),0,0xdeadbeef);
+  size_t k=0;
+  for (auto& i: objectRefs) i->as<Cell>()->myValue=values[k++];
 }
 
 void Cell::update(const Cell& from)
@@ -86,15 +95,19 @@ void Cell::update(const Cell& from)
   myValue = from.myValue + 0.1*(sumNbr - from.size()*from.myValue);
 }
 
-void Von::update()
+void Von::update(unsigned step)
 {
-  prepareNeighbours(true); /* make a copy of neighbouring objects
-				      onto the current thread */
+  /* with deep halos, ghosts need only be refreshed every haloDepth steps */
+  if (step%haloDepth==0)
+    prepareNeighbours(true); /* make a copy of neighbouring objects
+                                onto the current thread */
   Graph from;
   from.objects=objects.deepCopy();
   from.rebuildPtrLists();
-  for(auto& i: *this)
+  forUpdateSet(step, [&](ObjRef& i) {
     i->as<Cell>()->update( *from.objects[i.id()]);
+    i->touch(); /* for the versioned halo exchange */
+  });
 }
 	
 double localError(Graph<Cell>& pGraph, unsigned int size)
@@ -107,10 +120,7 @@ double localError(Graph<Cell>& pGraph, unsigned int size)
 
 double error(Graph<Cell>& pGraph, unsigned int size)
 {
-  double retval=0.0;
-  for (auto& i: pGraph.objects)
-    retval += fabs(i->myValue-0.5);
-  return retval;
+  return pGraph.sum([](const Cell& c) {return fabs(c.myValue-0.5);});
 }
 
 inline void swap(Von*& x, Von*& y)  { Von *t=x;  x=y;  y=t;}
@@ -124,20 +134,28 @@ int main(int argc, char** argv)
 
   if (argc<3) 
     {
-      printf("usage: %s gridsize niter\n",argv[0]);
+      printf("usage: %s gridsize niter [haloBackend [haloDepth [volumeEdgeWeights [tracePrefix]]]]\n",argv[0]);
       return 1;
     }
   const int testSize=atoi(argv[1]);
   const int nIter=atoi(argv[2]);
   
-  /* initialise random number generator */
-  initr(0xdeadbeef);
-  for(int junk=0; junk<(1<<16); junk++)
-    ibase();
-
   Von g;
+  if (argc>3)
+    g.haloBackend=GraphBase::HaloBackend(atoi(argv[3]));
+  if (argc>4)
+    g.haloDepth=atoi(argv[4]);
+  if (g.haloDepth<1)
+    {
+      printf("haloDepth must be at least 1\n");
+      return 1;
+    }
+  if (argc>5)
+    g.volumeEdgeWeights=atoi(argv[5]);
 
   g.setup(testSize);
+  if (argc>6)
+    g.startTrace(argv[6]);
 
   // In this case, objects are created insitu, so neither of the
   // following methods are needed. They are included just to exercise
@@ -145,7 +163,6 @@ int main(int argc, char** argv)
   g.partitionObjects();
   g.distributeObjects();
 
-  g.gather();
   double startError=error(g, testSize);
 
   for(int t=0; t<nIter; t++)
@@ -154,15 +171,33 @@ int main(int argc, char** argv)
       printf("On node %d: time is: %d, error is: %5.10f, updating...\n", 
 	     myid(), t, localError(g, testSize));
 #endif
-      g.update();
+      g.update(t);
+    }
+
+  double finalError=error(g, testSize);
+  double haloVolume=g.measuredHaloVolume();
+  if (myid()==0)
+    {
+      cout << "Total error="<<finalError<<endl;
+      cout << "Halo bytes per exchange: predicted="<<g.predictedHaloVolume
+           <<" measured="<<haloVolume<<endl;
     }
 
+  // gather is not needed either, but is exercised by checking the
+  // error of the gathered graph against the distributed sum
   g.gather();
   if (myid()==0)
     {
-      cout << "Total error="<<error(g, testSize)<<endl;
-      if (error(g, testSize)/ startError >0.2) return 1;
+      double gathered=0;
+      for (auto& i: g.objects)
+        gathered += fabs(i->myValue-0.5);
+      if (fabs(gathered-finalError) > 1e-9*finalError)
+        {
+          cout << "gathered error="<<gathered<<" differs"<<endl;
+          return 1;
+        }
     }
+  if (finalError/startError >0.2) return 1;
   return 0;
 }
 
@@ -11,5 +11,5 @@ struct Cell: graphcode::Object<Cell>
 {
   double myValue;
   void update(const Cell&);
-  Cell(): myValue(drand()) {}
+  Cell(): myValue(0) {}
 };
@@ -14,42 +14,163 @@
 
 namespace graphcode 
 {
+  void GraphBase::updateRequests()
+  {
+    if (haloDepth==0)
+      throw std::runtime_error("haloDepth must be at least 1");
+    rec_req.clear();
+    rec_req.resize(nprocs());
+    requests.clear();
+    requests.resize(nprocs());
+    subscribers.clear();
+    /* windows and communicators are laid out according to the plan */
+    rmaHalo.reset();
+    neighbourhoodHalo.reset();
+    sentVersions.clear();
+    for (auto& r: relationState)
+      r.planned=false;
+
+    /* locally hosted objects linking to each object */
+    dependants.clear();
+    for (auto& obj1:*this)
+      for (auto& obj2: *obj1)
+        if (obj2.id()!=obj1.id())
+          dependants[obj2.id()].push_back(obj1);
+
+    haloOrder.assign(begin(),end());
+    layerEnd.assign(1,haloOrder.size());
+
+#ifdef MPI_SUPPORT
+    if (nprocs()==1) return;
+    vector<set<GraphId> > uniq_req(nprocs());
+    /* build a list of ID requests to be sent to processors. Hubs
+       have mirrors instead, and gather from their links by updateHubs */
+    for (auto& obj1:*this)
+      if (!isHub(obj1.id()))
+        for (auto& obj2: *obj1)
+          if (obj2.proc()!=myid() && !isHub(obj2.id()))
+            uniq_req[obj2.proc()].insert(obj2.id());
+    std::unordered_set<GraphId> halo;
+    for (auto& r: uniq_req) halo.insert(r.begin(),r.end());
+
+    /* each layer of the halo is requested in turn, and appended to the plan */
+    for (unsigned depth=1; ; depth++)
+      {
+        /* now send & receive requests */
+        tag++;
+        vector<vector<GraphId> > newReq(nprocs()), newRec(nprocs());
+        MPIbuf_array sendbuf(nprocs());
+        for (unsigned proc=0; proc<nprocs(); proc++)
+          {
+            if (proc==myid()) continue;
+            sendbuf[proc] << uniq_req[proc] >> newReq[proc];
+            sendbuf[proc].isend(proc,tag);
+            requests[proc].insert(requests[proc].end(),newReq[proc].begin(),newReq[proc].end());
+            for (auto id: newReq[proc])
+              haloOrder.push_back(objectRef(id));
+            uniq_req[proc].clear();
+          }
+        layerEnd.push_back(haloOrder.size());
+        for (unsigned i=0; i<nprocs()-1; i++)
+          {
+            MPIbuf b; 
+            b.get(MPI_ANY_SOURCE,tag);
+            b >> newRec[b.proc];
+            rec_req[b.proc].insert(rec_req[b.proc].end(),newRec[b.proc].begin(),newRec[b.proc].end());
+          }
+        if (depth>=haloDepth) break;
+
+        /* fetch this layer, along with the hosts of the objects it
+           links to, which make up the next layer. Links to objects
+           unknown here are sent as noProc, and not followed */
+        const unsigned noProc=~0U;
+        tag++;
+        MPIbuf_array objbuf(nprocs());
+        for (unsigned proc=0; proc<nprocs(); proc++)
+          {
+            if (proc==myid()) continue;
+            for (auto id: newRec[proc])
+              {
+                auto& obj=objectRef(id);
+                objbuf[proc] << obj;
+                obj->forEachNeighbourId([&](GraphId n) {
+                    auto nbr=findObject(n);
+                    objbuf[proc] << (nbr? nbr->proc: noProc);
+                  });
+              }
+            objbuf[proc].isend(proc,tag);
+          }
+        for (unsigned i=0; i<nprocs()-1; i++)
+          {
+            MPIbuf b; 
+            b.get(MPI_ANY_SOURCE,tag);
+            for (auto id: newReq[b.proc])
+              {
+                auto& obj=objectRef(id);
+                b >> obj;
+                obj->forEachNeighbourId([&](GraphId n) {
+                    unsigned proc;
+                    b >> proc;
+                    if (proc!=myid() && proc!=noProc && !isHub(n) && halo.insert(n).second)
+                      {
+                        objectRef(n).proc=proc;
+                        uniq_req[proc].insert(n);
+                      }
+                  });
+              }
+          }
+      }
+
+    /* index of which processors cache each locally hosted object */
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      for (auto id: rec_req[proc])
+        subscribers[id].push_back(proc);
+#endif /* MPI_SUPPORT */
+  }
+
   void GraphBase::prepareNeighbours(bool cache_requests)
   {
+    beginPrepareNeighbours(cache_requests);
+    endPrepareNeighbours();
+  }
+
+  void GraphBase::beginPrepareNeighbours(bool cache_requests)
+  {
+    traceExchangeBegin("halo");
 #ifdef MPI_SUPPORT
     if (nprocs()==1) return;
-    vector<vector<ObjRef> > return_data(nprocs());
-    
     if (!cache_requests || rec_req.size()!=nprocs())
+      updateRequests();
+
+    traffic.rounds++;
+    traffic.full++;
+    switch (haloBackend)
       {
-	rec_req.clear();
-	rec_req.resize(nprocs());
-	requests.clear();
-	requests.resize(nprocs());
-        vector<set<GraphId> > uniq_req(nprocs());
-	/* build a list of ID requests to be sent to processors */
-	for (auto& obj1:*this)
-	  for (auto& obj2: *obj1)
-            if (obj2.proc()!=myid())
-              uniq_req[obj2.proc()].insert(obj2.id());
-
-	/* now send & receive requests */
-	tag++;
-	MPIbuf_array sendbuf(nprocs());
-	for (unsigned proc=0; proc<nprocs(); proc++)
-	  {
-	    if (proc==myid()) continue;
-	    sendbuf[proc] << uniq_req[proc] >> requests[proc];
-            sendbuf[proc].isend(proc,tag);
-	  }
-	for (unsigned i=0; i<nprocs()-1; i++)
-	  {
-	    MPIbuf b; 
-	    b.get(MPI_ANY_SOURCE,tag);
-	    b >> rec_req[b.proc];
-	  }
+      case sharedMemory: haloSharedMemory(); break;
+      case rma: haloRMA(); break;
+      case neighbourhood: haloNeighbourhoodBegin(); break;
+      case versioned: haloVersioned(); break;
+      default: haloTwoSided(); break;
+      }
+#endif /* MPI_SUPPORT */
+  }
+
+  void GraphBase::endPrepareNeighbours()
+  {
+#ifdef MPI_SUPPORT
+    if (nprocs()>1)
+      {
+        if (haloBackend==neighbourhood)
+          haloNeighbourhoodEnd();
+        rebuildPtrLists();
       }
+#endif /* MPI_SUPPORT */
+    traceExchangeEnd();
+  }
 
+  void GraphBase::haloTwoSided()
+  {
+#ifdef MPI_SUPPORT
     /* now service requests */
     tag++;
     MPIbuf_array sendbuf(nprocs());
@@ -64,10 +185,55 @@ namespace graphcode
     for (unsigned p=0; p<nprocs()-1; p++)
       {
 	MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+        haloReceived(b.proc,b.size());
 	for (unsigned i=0; i<requests[b.proc].size(); i++) 
 	  b>>objectRef(requests[b.proc][i]);
       }
-    rebuildPtrLists();
+#endif /* MPI_SUPPORT */
+  }
+
+  void GraphBase::haloVersioned()
+  {
+#ifdef MPI_SUPPORT
+    if (sentVersions.empty())
+      {
+        sentVersions.resize(nprocs());
+        for (unsigned proc=0; proc<nprocs(); proc++)
+          sentVersions[proc].assign(rec_req[proc].size(),~0UL);
+      }
+
+    /* objects are identified by their position in the request list */
+    tag++;
+    MPIbuf_array sendbuf(nprocs());
+    unsigned nRecv=0;
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      {
+        if (!rec_req[proc].empty())
+          {
+            for (size_t i=0; i<rec_req[proc].size(); i++)
+              {
+                auto& obj=objectRef(rec_req[proc][i]);
+                if (obj->version!=sentVersions[proc][i])
+                  {
+                    sendbuf[proc] << i << obj;
+                    sentVersions[proc][i]=obj->version;
+                  }
+              }
+            sendbuf[proc].isend(proc,tag);
+          }
+        if (!requests[proc].empty()) nRecv++;
+      }
+    for (unsigned i=0; i<nRecv; i++)
+      {
+        MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+        haloReceived(b.proc,b.size());
+        while (b.pos()<b.size())
+          {
+            size_t j;
+            b>>j;
+            b>>objectRef(requests[b.proc][j]);
+          }
+      }
 #endif /* MPI_SUPPORT */
   }
 
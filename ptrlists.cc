@@ -0,0 +1,176 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  namespace
+  {
+    /// number of pieces work is divided into
+    long numChunks()
+    {
+#ifdef _OPENMP
+      return omp_get_max_threads();
+#else
+      return 1;
+#endif
+    }
+
+    inline uint64_t hash(GraphId id) {return uint64_t(id)*0x9E3779B97F4A7C15ULL;}
+
+    /// the top \a bits bits of a multiplicative hash of \a id
+    inline size_t hashBits(GraphId id, unsigned bits)
+    {return bits? hash(id)>>(64-bits): 0;}
+
+    /**
+       the \a bits bits of the hash of \a id just below its top \a
+       skip bits. The low bits of a multiplicative hash depend only on
+       the low bits of the id, so ids sharing them would collide.
+    */
+    inline size_t hashSlot(GraphId id, unsigned skip, unsigned bits)
+    {return (hash(id)>>(64-skip-bits)) & ((size_t(1)<<bits)-1);}
+
+    /// objects per partition, so that each partition's hash table stays in cache
+    const size_t partitionSize=4096;
+
+    /**
+       radix partition \a x by the top \a bits bits of the hash of the
+       first member, returning the start of each partition
+    */
+    template <class V>
+    vector<size_t> radixPartition(vector<V>& x, unsigned bits)
+    {
+      size_t nParts=size_t(1)<<bits;
+      long n=numChunks();
+      /* per chunk histograms, which become per chunk scatter offsets */
+      vector<vector<size_t> > offset(n, vector<size_t>(nParts));
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for (long k=0; k<n; k++)
+        for (size_t i=x.size()*k/n; i<x.size()*(k+1)/n; i++)
+          offset[k][hashBits(x[i].first,bits)]++;
+      vector<size_t> start(nParts+1);
+      size_t sum=0;
+      for (size_t p=0; p<nParts; p++)
+        {
+          start[p]=sum;
+          for (long k=0; k<n; k++)
+            {
+              size_t c=offset[k][p];
+              offset[k][p]=sum;
+              sum+=c;
+            }
+        }
+      start[nParts]=sum;
+      vector<V> r(x.size());
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for (long k=0; k<n; k++)
+        for (size_t i=x.size()*k/n; i<x.size()*(k+1)/n; i++)
+          r[offset[k][hashBits(x[i].first,bits)]++]=x[i];
+      x.swap(r);
+      return start;
+    }
+  }
+
+  void GraphBase::bulkUpdatePtrLists(const PtrList::Allocator& alloc)
+  {
+    /* the object table */
+    vector<std::pair<GraphId,ObjectPtrBase*> > table(objectRefs.size());
+    /* start of each object's links in the flattened adjacency */
+    vector<size_t> start(objectRefs.size()+1);
+    for (size_t i=0; i<objectRefs.size(); i++)
+      {
+        auto& o=objectRefs[i];
+        table[i]={o.id(),o.payload};
+        start[i+1]=start[i]+(o? o->neighbourCount(): 0);
+      }
+
+    /* (neighbour id, position in flattened adjacency) for every link */
+    vector<std::pair<GraphId,size_t> > links(start.back());
+    long nObjects=objectRefs.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1024)
+#endif
+    for (long i=0; i<nObjects; i++)
+      if (auto& o=objectRefs[i])
+        {
+          size_t j=start[i];
+          o->forEachNeighbourId([&](GraphId n) {links[j]={n,j}; j++;});
+        }
+
+    /* partition both sides identically, so each partition of links
+       only refers to the matching partition of the table */
+    unsigned bits=0;
+    while ((table.size()>>bits)>partitionSize) bits++;
+    auto tableStart=radixPartition(table,bits);
+    auto linkStart=radixPartition(links,bits);
+
+    /* hash join each partition independently */
+    vector<ObjectPtrBase*> resolved(links.size());
+    long nParts=long(1)<<bits;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      vector<std::pair<GraphId,ObjectPtrBase*> > hashTable;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (long p=0; p<nParts; p++)
+        {
+          unsigned hbits=1;
+          while ((size_t(1)<<hbits) < 2*(tableStart[p+1]-tableStart[p])) hbits++;
+          size_t mask=(size_t(1)<<hbits)-1;
+          hashTable.assign(mask+1,{badId,nullptr});
+          /* the partition fixes the top bits of the hash, so slots take the next ones */
+          for (size_t i=tableStart[p]; i<tableStart[p+1]; i++)
+            {
+              size_t h=hashSlot(table[i].first,bits,hbits);
+              while (hashTable[h].first!=badId) h=(h+1)&mask;
+              hashTable[h]=table[i];
+            }
+          for (size_t i=linkStart[p]; i<linkStart[p+1]; i++)
+            {
+              size_t h=hashSlot(links[i].first,bits,hbits);
+              while (hashTable[h].first!=badId && hashTable[h].first!=links[i].first)
+                h=(h+1)&mask;
+              resolved[links[i].second]=hashTable[h].second;
+            }
+        }
+    }
+
+    /* write each object's links, in neighbour order, skipping those not present */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1024)
+#endif
+    for (long i=0; i<nObjects; i++)
+      if (auto& o=objectRefs[i])
+        {
+          o->clear();
+          o->setAllocator(alloc);
+          o->reserve(start[i+1]-start[i]);
+          for (size_t j=start[i]; j<start[i+1]; j++)
+            if (resolved[j])
+              {
+                assert(*resolved[j]);
+                o->emplace_back(*resolved[j]);
+              }
+        }
+  }
+}
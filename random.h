@@ -0,0 +1,143 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/**
+   Counter based random number generation (Philox4x32-10, Salmon et
+   al., "Parallel random numbers: as easy as 1, 2, 3", SC11).
+
+   Variates are a pure function of (seed, object id, step, index), so
+   objects may be initialised or updated in any order, on any number of
+   processors or threads, and always see the same numbers. There is no
+   shared generator state.
+*/
+
+#ifndef GRAPHCODE_RANDOM_H
+#define GRAPHCODE_RANDOM_H
+
+#include "graphcode.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+namespace graphcode
+{
+  /// the Philox4x32-10 block function
+  struct Philox4x32
+  {
+    typedef std::array<uint32_t,4> Counter;
+    typedef std::array<uint32_t,2> Key;
+
+    static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+    {
+      uint64_t p=uint64_t(a)*b;
+      hi=p>>32;
+      lo=uint32_t(p);
+    }
+
+    /// encrypt counter \a c with key \a k
+    static Counter generate(Counter c, Key k)
+    {
+      for (int round=0; round<10; ++round)
+        {
+          uint32_t hi0, lo0, hi1, lo1;
+          mulhilo(0xD2511F53,c[0],hi0,lo0);
+          mulhilo(0xCD9E8D57,c[2],hi1,lo1);
+          c={hi1^c[1]^k[0], lo1, hi0^c[3]^k[1], lo0};
+          k[0]+=0x9E3779B9;
+          k[1]+=0xBB67AE85;
+        }
+      return c;
+    }
+
+    static Key key(GraphId id) {return {uint32_t(id), uint32_t(uint64_t(id)>>32)};}
+    /// counter of the \a block'th group of 4 variates
+    static Counter counter(uint32_t block, uint64_t step, uint32_t seed)
+    {return {block, uint32_t(step), uint32_t(step>>32), seed};}
+
+    /// uniform double on [0,1) with 53 random bits, from two 32 bit variates
+    static double toDouble(uint32_t a, uint32_t b)
+    {return ((a>>5)*67108864.0+(b>>6))*(1.0/9007199254740992.0);}
+  };
+
+  /**
+     The stream of variates belonging to object \a id at time step \a
+     step. Satisfies UniformRandomBitGenerator, so may be used with
+     the std distributions.
+  */
+  class RandomStream
+  {
+    Philox4x32::Key key;
+    uint64_t step;
+    uint32_t seed, block=0;
+    Philox4x32::Counter buffer;
+    unsigned used=4;
+  public:
+    typedef uint32_t result_type;
+    static constexpr result_type min() {return 0;}
+    static constexpr result_type max() {return ~result_type(0);}
+
+    RandomStream(GraphId id, uint64_t step=0, uint32_t seed=0):
+      key(Philox4x32::key(id)), step(step), seed(seed) {}
+
+    /// next 32 bit variate
+    result_type operator()() {
+      if (used==4)
+        {
+          buffer=Philox4x32::generate(Philox4x32::counter(block++,step,seed),key);
+          used=0;
+        }
+      return buffer[used++];
+    }
+    /// uniform on [0,1)
+    double uniform() {
+      uint32_t a=(*this)();
+      return Philox4x32::toDouble(a,(*this)());
+    }
+    /// standard normal, by the Box-Muller transform
+    double normal() {
+      double u=1-uniform(); /* on (0,1] */
+      return std::sqrt(-2*std::log(u))*std::cos(2*M_PI*uniform());
+    }
+
+    /**
+       fill \a x[0..n) with uniform variates. Whole blocks are
+       generated independently, so the loop vectorises. The stream
+       continues from the next unused block.
+    */
+    void fillUniform(double* x, size_t n) {
+      size_t blocks=(n+1)/2;
+      for (size_t b=0; b<blocks; ++b)
+        {
+          auto r=Philox4x32::generate(Philox4x32::counter(block+b,step,seed),key);
+          x[2*b]=Philox4x32::toDouble(r[0],r[1]);
+          if (2*b+1<n) x[2*b+1]=Philox4x32::toDouble(r[2],r[3]);
+        }
+      block+=blocks;
+      used=4;
+    }
+  };
+
+  /**
+     one uniform variate for each of \a n objects: \a x[i] is the first
+     variate of RandomStream(ids[i],step,seed). Objects are
+     independent, so the loop vectorises.
+  */
+  inline void uniformBatch(const GraphId* ids, size_t n, double* x,
+                           uint64_t step=0, uint32_t seed=0)
+  {
+    auto c=Philox4x32::counter(0,step,seed);
+    for (size_t i=0; i<n; ++i)
+      {
+        auto r=Philox4x32::generate(c,Philox4x32::key(ids[i]));
+        x[i]=Philox4x32::toDouble(r[0],r[1]);
+      }
+  }
+}
+
+#endif
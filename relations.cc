@@ -0,0 +1,117 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <stdexcept>
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  unsigned GraphBase::addRelation(const std::string& name)
+  {
+    if (relationNames.empty()) relationNames.push_back("neighbours");
+    for (unsigned r=0; r<relationNames.size(); r++)
+      if (relationNames[r]==name) return r;
+    relationNames.push_back(name);
+    relationState.resize(relationNames.size());
+    return relationNames.size()-1;
+  }
+
+  unsigned GraphBase::relation(const std::string& name) const
+  {
+    if (name=="neighbours") return 0;
+    for (unsigned r=1; r<relationNames.size(); r++)
+      if (relationNames[r]==name) return r;
+    throw std::runtime_error("unknown relation "+name);
+  }
+
+  void GraphBase::buildRelation(unsigned r)
+  {
+    if (r>=relationState.size()) relationState.resize(r+1);
+    auto& s=relationState[r];
+    s.offsets.assign(1,0);
+    s.offsets.reserve(size()+1);
+    s.links.clear();
+    /* links to objects absent locally are skipped, as with PtrLists */
+    for (auto& i: *this)
+      {
+        i->forEachLinkId(r,[&](GraphId id) {
+          if (auto o=findObject(id))
+            if (*o)
+              s.links.emplace_back(*o);
+        });
+        s.offsets.push_back(s.links.size());
+      }
+  }
+
+  void GraphBase::prepareRelation(unsigned r)
+  {
+#ifdef MPI_SUPPORT
+    if (nprocs()==1) return;
+    /* the relation's plan is discarded whenever the main plan is recomputed */
+    if (rec_req.size()!=nprocs())
+      updateRequests();
+    if (r>=relationState.size()) relationState.resize(r+1);
+    traceExchangeBegin("relation");
+    auto& s=relationState[r];
+    if (!s.planned)
+      {
+        s.rec_req.assign(nprocs(),{});
+        s.requests.assign(nprocs(),{});
+        vector<set<GraphId> > uniq_req(nprocs());
+        for (auto& i: *this)
+          i->forEachLinkId(r,[&](GraphId id) {
+            if (auto o=findObject(id))
+              if (o->proc!=myid())
+                uniq_req[o->proc].insert(id);
+          });
+
+        tag++;
+        MPIbuf_array sendbuf(nprocs());
+        for (unsigned proc=0; proc<nprocs(); proc++)
+          {
+            if (proc==myid()) continue;
+            sendbuf[proc] << uniq_req[proc] >> s.requests[proc];
+            sendbuf[proc].isend(proc,tag);
+          }
+        for (unsigned i=0; i<nprocs()-1; i++)
+          {
+            MPIbuf b;
+            b.get(MPI_ANY_SOURCE,tag);
+            b >> s.rec_req[b.proc];
+          }
+        s.planned=true;
+        /* ghosts arriving for the first time are not yet in the adjacency */
+        s.offsets.clear();
+      }
+
+    tag++;
+    MPIbuf_array sendbuf(nprocs());
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      {
+        if (proc==myid()) continue;
+        for (auto id: s.rec_req[proc])
+          sendbuf[proc] << objectRef(id);
+        sendbuf[proc].isend(proc,tag);
+      }
+    for (unsigned p=0; p<nprocs()-1; p++)
+      {
+        MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+        traceMessage(b.proc,b.size());
+        for (auto id: s.requests[b.proc])
+          b>>objectRef(id);
+      }
+    /* ghosts are replaced on receipt, but entries, and so the adjacency, are not */
+    localIndexData.stale=true;
+    traceExchangeEnd();
+#endif /* MPI_SUPPORT */
+  }
+}
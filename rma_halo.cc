@@ -0,0 +1,152 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <cstring>
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+namespace graphcode
+{
+  /*
+     Two windows are exposed by each processor:
+     - an index window, holding the (offset, length) of each object
+       requested by each neighbour, laid out in the neighbour's request
+       order. Its layout is fixed by the request plan.
+     - a data window, holding the serialised boundary objects, which
+       grows as required.
+  */
+  struct GraphBase::RMAHaloState
+  {
+#ifdef MPI_SUPPORT
+    vector<GraphId> exposed; /* boundary objects, in data window order */
+    vector<MPI_Aint> index, remoteIndex, offset, length;
+    vector<vector<size_t> > position; /* of rec_req entries in exposed */
+    MPI_Win indexWin=MPI_WIN_NULL, dataWin=MPI_WIN_NULL;
+    vector<char> data;
+
+    RMAHaloState(const GraphBase& g)
+    {
+      std::unordered_map<GraphId,size_t> pos;
+      for (auto& i: g.subscribers)
+        {
+          pos[i.first]=exposed.size();
+          exposed.push_back(i.first);
+        }
+      offset.resize(exposed.size());
+      length.resize(exposed.size());
+
+      /* displacement of each neighbour's block in the index window */
+      vector<MPI_Aint> start(nprocs());
+      size_t n=0;
+      position.resize(nprocs());
+      for (unsigned proc=0; proc<nprocs(); proc++)
+        {
+          start[proc]=n;
+          for (auto id: g.rec_req[proc])
+            position[proc].push_back(pos[id]);
+          n+=2*g.rec_req[proc].size();
+        }
+      index.resize(n);
+      remoteIndex.resize(nprocs());
+      MPI_Alltoall(start.data(),1,MPI_AINT,remoteIndex.data(),1,MPI_AINT,MPI_COMM_WORLD);
+      MPI_Win_create(index.data(),n*sizeof(MPI_Aint),sizeof(MPI_Aint),MPI_INFO_NULL,
+                     MPI_COMM_WORLD,&indexWin);
+    }
+    ~RMAHaloState()
+    {
+      if (MPI_running())
+        {
+          MPI_Win_free(&indexWin);
+          if (dataWin!=MPI_WIN_NULL) MPI_Win_free(&dataWin);
+        }
+    }
+    /// ensure data window holds at least \a size bytes. Collective.
+    void reserve(size_t size)
+    {
+      int grow=dataWin==MPI_WIN_NULL || size>data.size(), anyGrow;
+      MPI_Allreduce(&grow,&anyGrow,1,MPI_INT,MPI_LOR,MPI_COMM_WORLD);
+      if (!anyGrow) return;
+      if (dataWin!=MPI_WIN_NULL) MPI_Win_free(&dataWin);
+      if (grow) data.resize(2*size);
+      MPI_Win_create(data.data(),data.size(),1,MPI_INFO_NULL,MPI_COMM_WORLD,&dataWin);
+    }
+#endif
+  };
+
+  void GraphBase::haloRMA()
+  {
+#ifdef MPI_SUPPORT
+    if (!rmaHalo) rmaHalo.reset(new RMAHaloState(*this));
+    RMAHaloState& s=*rmaHalo;
+
+    /* serialise boundary objects, and publish their locations */
+    pack_t buf;
+    for (size_t i=0; i<s.exposed.size(); i++)
+      {
+        s.offset[i]=buf.size();
+        buf << objectRef(s.exposed[i]);
+        s.length[i]=buf.size()-s.offset[i];
+      }
+    size_t n=0;
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      for (auto i: s.position[proc])
+        {
+          s.index[n++]=s.offset[i];
+          s.index[n++]=s.length[i];
+        }
+    s.reserve(buf.size());
+    memcpy(s.data.data(),buf.data(),buf.size());
+
+    /* fetch the locations of our requests */
+    vector<vector<MPI_Aint> > located(nprocs());
+    MPI_Win_fence(MPI_MODE_NOPRECEDE,s.indexWin);
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      if (int count=2*requests[proc].size())
+        {
+          located[proc].resize(count);
+          MPI_Get(located[proc].data(),count,MPI_AINT,proc,s.remoteIndex[proc],
+                  count,MPI_AINT,s.indexWin);
+        }
+    MPI_Win_fence(MPI_MODE_NOSUCCEED,s.indexWin);
+
+    /* fetch the objects, coalescing adjacent ones into a single get */
+    vector<vector<char> > received(nprocs());
+    MPI_Win_fence(MPI_MODE_NOPRECEDE,s.dataWin);
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      {
+        auto& loc=located[proc];
+        MPI_Aint total=0;
+        for (size_t i=1; i<loc.size(); i+=2) total+=loc[i];
+        received[proc].resize(total);
+        if (total) haloReceived(proc,total);
+        char* dest=received[proc].data();
+        for (size_t i=0; i<loc.size();)
+          {
+            MPI_Aint start=loc[i], len=loc[i+1];
+            for (i+=2; i<loc.size() && loc[i]==start+len; i+=2)
+              len+=loc[i+1];
+            MPI_Get(dest,len,MPI_CHAR,proc,start,len,MPI_CHAR,s.dataWin);
+            dest+=len;
+          }
+      }
+    MPI_Win_fence(MPI_MODE_NOSUCCEED,s.dataWin);
+
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      if (!requests[proc].empty())
+        {
+          pack_t b;
+          b.packraw(received[proc].data(),received[proc].size());
+          for (auto id: requests[proc])
+            b>>objectRef(id);
+        }
+#endif
+  }
+}
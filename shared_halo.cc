@@ -0,0 +1,163 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <numeric>
+#include <cstring>
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+#if defined(MPI_SUPPORT) && defined(MPI_VERSION) && MPI_VERSION>=3
+#define SHARED_HALO
+#endif
+
+namespace graphcode
+{
+  /*
+     Each processor's segment of the window starts with a table of
+     offsets, one per processor on the node, followed by the serialised
+     objects requested by each of those processors in turn.
+  */
+  struct GraphBase::SharedHaloState
+  {
+#ifdef SHARED_HALO
+    MPI_Comm nodeComm=MPI_COMM_NULL;
+    int nodeSize, nodeRank;
+    vector<int> worldRank; /* processor number of each node rank */
+    MPI_Win win=MPI_WIN_NULL;
+    char* segment=nullptr;
+    MPI_Aint capacity=0;
+
+    SharedHaloState()
+    {
+      MPI_Comm_split_type(MPI_COMM_WORLD,MPI_COMM_TYPE_SHARED,0,MPI_INFO_NULL,&nodeComm);
+      MPI_Comm_size(nodeComm,&nodeSize);
+      MPI_Comm_rank(nodeComm,&nodeRank);
+      MPI_Group world, node;
+      MPI_Comm_group(MPI_COMM_WORLD,&world);
+      MPI_Comm_group(nodeComm,&node);
+      vector<int> ranks(nodeSize);
+      std::iota(ranks.begin(),ranks.end(),0);
+      worldRank.resize(nodeSize);
+      MPI_Group_translate_ranks(node,nodeSize,ranks.data(),world,worldRank.data());
+      MPI_Group_free(&world);
+      MPI_Group_free(&node);
+    }
+    ~SharedHaloState()
+    {
+      if (MPI_running())
+        {
+          freeWindow();
+          MPI_Comm_free(&nodeComm);
+        }
+    }
+    void freeWindow()
+    {
+      if (win!=MPI_WIN_NULL)
+        {
+          MPI_Win_unlock_all(win);
+          MPI_Win_free(&win);
+        }
+    }
+    /// ensure this segment holds at least \a size bytes. Collective over the node.
+    void reserve(MPI_Aint size)
+    {
+      int grow=size>capacity, anyGrow;
+      MPI_Allreduce(&grow,&anyGrow,1,MPI_INT,MPI_LOR,nodeComm);
+      if (!anyGrow) return;
+      freeWindow();
+      if (grow) capacity=2*size;
+      MPI_Win_allocate_shared(capacity,1,MPI_INFO_NULL,nodeComm,&segment,&win);
+      MPI_Win_lock_all(MPI_MODE_NOCHECK,win);
+    }
+    /// barrier making all segment writes visible across the node
+    void synchronise()
+    {
+      MPI_Win_sync(win);
+      MPI_Barrier(nodeComm);
+      MPI_Win_sync(win);
+    }
+#endif
+  };
+
+  void GraphBase::haloSharedMemory()
+  {
+#ifdef SHARED_HALO
+    if (!sharedHalo) sharedHalo.reset(new SharedHaloState);
+    SharedHaloState& s=*sharedHalo;
+    vector<bool> onNode(nprocs(),false);
+    for (auto p: s.worldRank) onNode[p]=true;
+
+    /* messages between nodes are posted first, to overlap with the
+       shared memory exchange */
+    tag++;
+    MPIbuf_array sendbuf(nprocs());
+    unsigned nRecv=0;
+    for (unsigned proc=0; proc<nprocs(); proc++)
+      if (!onNode[proc])
+        {
+          if (!rec_req[proc].empty())
+            {
+              for (auto id: rec_req[proc])
+                sendbuf[proc] << objectRef(id);
+              sendbuf[proc].isend(proc,tag);
+            }
+          if (!requests[proc].empty()) nRecv++;
+        }
+
+    /* publish objects requested by processors on this node */
+    vector<MPI_Aint> offsets(s.nodeSize+1);
+    MPI_Aint header=offsets.size()*sizeof(MPI_Aint);
+    pack_t buf;
+    for (int q=0; q<s.nodeSize; q++)
+      {
+        offsets[q]=header+buf.size();
+        if (q!=s.nodeRank)
+          for (auto id: rec_req[s.worldRank[q]])
+            buf << objectRef(id);
+      }
+    offsets[s.nodeSize]=header+buf.size();
+    s.reserve(offsets[s.nodeSize]);
+    memcpy(s.segment,offsets.data(),header);
+    memcpy(s.segment+header,buf.data(),buf.size());
+    s.synchronise();
+
+    /* read objects from neighbours' segments directly */
+    for (int q=0; q<s.nodeSize; q++)
+      {
+        auto& req=requests[s.worldRank[q]];
+        if (q==s.nodeRank || req.empty()) continue;
+        MPI_Aint size;
+        int dispUnit;
+        char* base;
+        MPI_Win_shared_query(s.win,q,&size,&dispUnit,&base);
+        auto theirOffsets=reinterpret_cast<const MPI_Aint*>(base);
+        pack_t b;
+        b.packraw(base+theirOffsets[s.nodeRank],
+                  theirOffsets[s.nodeRank+1]-theirOffsets[s.nodeRank]);
+        haloReceived(s.worldRank[q],b.size());
+        for (auto id: req)
+          b>>objectRef(id);
+      }
+
+    for (unsigned i=0; i<nRecv; i++)
+      {
+        MPIbuf b; b.get(MPI_ANY_SOURCE,tag);
+        haloReceived(b.proc,b.size());
+        for (auto id: requests[b.proc])
+          b>>objectRef(id);
+      }
+    /* segments must not be rewritten until all readers are finished */
+    MPI_Barrier(s.nodeComm);
+#else
+    haloTwoSided();
+#endif
+  }
+}
@@ -0,0 +1,113 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/*
+  check distributed graph algorithms against known answers on a torus,
+  plus a disjoint triangle and 5-ring
+*/
+
+#ifdef MPI_SUPPORT
+#include <mpi.h>
+#endif
+#include "../graphcode.h"
+#include "../algorithms.h"
+#include <stdio.h>
+using namespace graphcode;
+
+struct Node: public graphcode::Object<Node> {};
+
+// algorithm state lives outside the nodes, so no serialisation needed
+namespace classdesc_access
+{
+  template <>
+  struct access_pack<Node>:
+    public classdesc::NullDescriptor<classdesc::pack_t> {};
+  template <>
+  struct access_unpack<Node>:
+    public classdesc::NullDescriptor<classdesc::pack_t> {};
+  template <>
+  struct access_RESTProcess<Node>:
+    public classdesc::NullDescriptor<classdesc::RESTProcess_t> {};
+}
+
+#include <classdesc_epilogue.h>
+
+const int size=8;
+const GraphId triangle=size*size, ring=triangle+3;
+int failures=0;
+
+void check(bool cond, const char* msg, GraphId id)
+{
+  if (!cond)
+    {
+      fprintf(stderr,"proc %d: %s failed for %lu\n",myid(),msg,id);
+      failures++;
+    }
+}
+
+GraphId makeId(int x, int y) {return Wrap(x,size) + size*Wrap(y,size);}
+
+int main(int argc, char** argv)
+{
+#ifdef MPI_SUPPORT
+  MPISPMD c(argc,argv);
+#endif
+  Graph<Node> g;
+  for (int y=0; y<size; y++)
+    for (int x=0; x<size; x++)
+      {
+        ObjRef o=g.insertObject(makeId(x,y));
+        o.proc(y*nprocs()/size);
+        o->neighbours={makeId(x-1,y),makeId(x+1,y),makeId(x,y-1),makeId(x,y+1)};
+      }
+  for (GraphId i=0; i<3; i++)
+    {
+      ObjRef o=g.insertObject(triangle+i);
+      o.proc(i%nprocs());
+      o->neighbours={triangle+(i+1)%3, triangle+(i+2)%3};
+    }
+  for (GraphId i=0; i<5; i++)
+    {
+      ObjRef o=g.insertObject(ring+i);
+      o.proc((i+1)%nprocs());
+      o->neighbours={ring+(i+1)%5, ring+(i+4)%5};
+    }
+  g.rebuildPtrLists();
+
+  auto level=bfsLevels(g,0);
+  auto label=connectedComponents(g);
+  auto dist=shortestPaths(g,0);
+  auto core=coreNumbers(g);
+  auto rank=pageRank(g);
+  unsigned long triangles=triangleCount(g);
+
+  double totalRank=0;
+  for (auto& i: g)
+    {
+      totalRank+=rank[i.id()];
+      if (i.id()<triangle)
+        {
+          int x=i.id()%size, y=i.id()/size;
+          unsigned manhattan=std::min(x,size-x)+std::min(y,size-y);
+          check(level.count(i.id()) && level[i.id()]==manhattan,"bfsLevels",i.id());
+          check(dist[i.id()]==manhattan,"shortestPaths",i.id());
+          check(label[i.id()]==0,"connectedComponents",i.id());
+          check(core[i.id()]==4,"coreNumbers",i.id());
+        }
+      else
+        {
+          check(level.count(i.id())==0,"bfsLevels",i.id());
+          check(dist[i.id()]==std::numeric_limits<double>::infinity(),"shortestPaths",i.id());
+          check(label[i.id()]==(i.id()<ring? triangle: ring),"connectedComponents",i.id());
+          check(core[i.id()]==2,"coreNumbers",i.id());
+        }
+    }
+  check(triangles==1,"triangleCount",triangles);
+  check(std::fabs(allReduce(totalRank,ReduceOp::sum)-1)<1e-6,"pageRank",0);
+  return failures>0;
+}
@@ -0,0 +1,96 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/*
+  load a torus from an edge list file, listing each edge once, in
+  batches small enough to split lines, and check every object hosted
+  has its four neighbours
+*/
+
+#ifdef MPI_SUPPORT
+#include <mpi.h>
+#endif
+#include "../graphcode.h"
+#include "../algorithms.h"
+#include <stdio.h>
+using namespace graphcode;
+
+struct Node: public graphcode::Object<Node> {};
+
+namespace classdesc_access
+{
+  template <>
+  struct access_pack<Node>:
+    public classdesc::NullDescriptor<classdesc::pack_t> {};
+  template <>
+  struct access_unpack<Node>:
+    public classdesc::NullDescriptor<classdesc::pack_t> {};
+  template <>
+  struct access_RESTProcess<Node>:
+    public classdesc::NullDescriptor<classdesc::RESTProcess_t> {};
+}
+
+#include <classdesc_epilogue.h>
+
+const int size=16;
+int failures=0;
+
+void check(bool cond, const char* msg, GraphId id)
+{
+  if (!cond)
+    {
+      fprintf(stderr,"proc %d: %s failed for %lu\n",myid(),msg,id);
+      failures++;
+    }
+}
+
+GraphId makeId(int x, int y) {return Wrap(x,size) + size*Wrap(y,size);}
+
+int main(int argc, char** argv)
+{
+#ifdef MPI_SUPPORT
+  MPISPMD c(argc,argv);
+#endif
+  const char* file="edges.txt";
+  if (myid()==0)
+    {
+      FILE* f=fopen(file,"w");
+      fprintf(f,"# torus %d x %d\n",size,size);
+      for (int y=0; y<size; y++)
+        for (int x=0; x<size; x++)
+          {
+            fprintf(f,"%lu\t%lu 1.0\n",makeId(x,y),makeId(x+1,y));
+            fprintf(f,"%lu %lu\n",makeId(x,y),makeId(x,y+1));
+          }
+      fclose(f);
+    }
+#ifdef MPI_SUPPORT
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+
+  Graph<Node> g;
+  auto links=g.readEdgeList(file,true,37);
+  unsigned long n=links.size();
+  check(allReduce(n,ReduceOp::sum)==size*size,"object count",n);
+  for (auto& l: links)
+    {
+      check(GraphBase::loadOwner(l.first)==myid(),"owner",l.first);
+      check(l.second.size()==4,"degree",l.first);
+    }
+
+  g.loadEdgeList(file);
+  g.prepareNeighbours();
+  auto level=bfsLevels(g,0);
+  for (auto& i: g)
+    {
+      int x=i.id()%size, y=i.id()/size;
+      unsigned manhattan=std::min(x,size-x)+std::min(y,size-y);
+      check(level.count(i.id()) && level[i.id()]==manhattan,"bfsLevels",i.id());
+    }
+  return failures>0;
+}
@@ -0,0 +1,1036 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/*
+  behavioural tests of Graph, on a torus plus a disjoint triangle and
+  5-ring. Each test is selected by name on the command line, so the
+  test driver can run each at different processor counts.
+*/
+
+#ifdef MPI_SUPPORT
+#include <mpi.h>
+#endif
+#include "graphcode.h"
+#include "graphcode.cd"
+#include "builder.h"
+#include "messages.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+using namespace graphcode;
+
+#include "testGraph.h"
+#include "testGraph.cd"
+#include <classdesc_epilogue.h>
+
+const int size=16;
+const GraphId triangle=size*size, ring=triangle+3;
+int failures=0;
+
+void check(bool cond, const char* msg, GraphId id=0)
+{
+  if (!cond)
+    {
+      fprintf(stderr,"proc %d: %s failed for %lu\n",myid(),msg,id);
+      failures++;
+    }
+}
+
+GraphId makeId(int x, int y) {return Wrap(x,size) + size*Wrap(y,size);}
+
+/// torus distributed by rows, triangle and ring scattered
+template <class T>
+void build(Graph<T>& g)
+{
+  for (int y=0; y<size; y++)
+    for (int x=0; x<size; x++)
+      {
+        ObjRef o=g.insertObject(makeId(x,y));
+        o.proc(y*nprocs()/size);
+        o->neighbours={makeId(x-1,y),makeId(x+1,y),makeId(x,y-1),makeId(x,y+1)};
+      }
+  for (GraphId i=0; i<3; i++)
+    {
+      ObjRef o=g.insertObject(triangle+i);
+      o.proc(i%nprocs());
+      o->neighbours={triangle+(i+1)%3, triangle+(i+2)%3};
+    }
+  for (GraphId i=0; i<5; i++)
+    {
+      ObjRef o=g.insertObject(ring+i);
+      o.proc((i+1)%nprocs());
+      o->neighbours={ring+(i+1)%5, ring+(i+4)%5};
+    }
+  g.rebuildPtrLists();
+}
+
+/// smallest id of the component containing \a id
+GraphId component(GraphId id)
+{return id<triangle? 0: id<ring? triangle: ring;}
+
+/// label propagation by asyncIterate converges, and terminates on all processors
+void testAsync()
+{
+  Graph<Cell> g;
+  build(g);
+  for (auto& i: g.objectRefs) i->as<Cell>()->value=i.id();
+  unsigned sweeps=g.asyncIterate([](ObjRef& x) {
+      auto& c=*x->as<Cell>();
+      double m=c.value;
+      for (auto& n: *x) m=std::min(m,n->as<Cell>()->value);
+      bool changed=m<c.value;
+      c.value=m;
+      return changed;
+    });
+  for (auto& i: g)
+    check(i->as<Cell>()->value==component(i.id()),"asyncIterate",i.id());
+  /* a sweep may only be wasted waiting for the last ghost updates */
+  check(sweeps>0 && sweeps<=size*size,"asyncIterate sweeps",sweeps);
+  /* a bounded run stops after maxSweeps, even though not converged */
+  for (auto& i: g.objectRefs) i->as<Cell>()->value=i.id();
+  sweeps=g.asyncIterate([](ObjRef& x) {
+      auto& c=*x->as<Cell>();
+      c.value-=1;
+      return true;
+    },3);
+  check(sweeps==3,"asyncIterate maxSweeps",sweeps);
+}
+
+/**
+   breadth first distances from 0 by active set scheduling, returning
+   the total number of kernel calls on all processors
+*/
+unsigned long activeDistances(double denseThreshold)
+{
+  Graph<Cell> g;
+  build(g);
+  g.denseThreshold=denseThreshold;
+  for (auto& i: g.objectRefs) i->as<Cell>()->value=i.id()==0? 0: 1e9;
+  g.prepareNeighbours();
+  g.activateAll();
+  unsigned long work=0;
+  while (allReduce(g.active.size(),ReduceOp::sum)>0)
+    {
+      for (auto& x: g.active)
+        {
+          auto& c=*x->as<Cell>();
+          for (auto& n: *x)
+            if (n->as<Cell>()->value+1 < c.value)
+              {
+                c.value=n->as<Cell>()->value+1;
+                g.markChanged(x.id());
+              }
+          work++;
+        }
+      g.advanceActive();
+    }
+  for (auto& i: g)
+    if (i.id()<triangle)
+      {
+        int x=i.id()%size, y=i.id()/size;
+        double manhattan=std::min(x,size-x)+std::min(y,size-y);
+        check(i->as<Cell>()->value==manhattan,"advanceActive",i.id());
+      }
+    else
+      check(i->as<Cell>()->value==1e9,"advanceActive",i.id());
+  return allReduce(work,ReduceOp::sum);
+}
+
+/// dense and frontier-sparse scheduling agree, and sparse does less work
+void testActive()
+{
+  unsigned long dense=activeDistances(0);
+  unsigned long mixed=activeDistances(0.1);
+  unsigned long sparse=activeDistances(2);
+  check(sparse<dense,"sparse scheduling work",sparse);
+  check(mixed<=dense,"mixed scheduling work",mixed);
+}
+
+/// histogram bins out of range values at the ends, and skips NaNs
+void testHistogram()
+{
+  Graph<Cell> g;
+  build(g);
+  const double inf=std::numeric_limits<double>::infinity();
+  const double extra[]={std::nan(""),inf,-inf,1e300,-1e300,300,-5,8};
+  for (auto& i: g.objectRefs)
+    i->as<Cell>()->value= i.id()<triangle? i.id(): extra[i.id()-triangle];
+  auto counts=g.histogram([](const Cell& c) {return c.value;},0,size*size,size);
+  check(counts.size()==size,"histogram size",counts.size());
+  for (unsigned b=0; b<counts.size(); b++)
+    check(counts[b]==(b==0? 20: b==size-1? 19: size),"histogram",b);
+}
+
+/// each processor's share of every constraint follows its capacity
+void testWeights()
+{
+  Graph<Weighted> g;
+  build(g);
+  /* the first quarter of the rows, all on processor 0, are heavy in memory */
+  for (auto& i: g.objectRefs)
+    i->as<Weighted>()->memory= i.id()<size*size/4? 4: 1;
+  g.setCapacity(myid()+1);
+  check(g.capacity.size()==nprocs(),"setCapacity size",g.capacity.size());
+  for (unsigned p=0; p<g.capacity.size(); p++)
+    check(g.capacity[p]==p+1,"setCapacity",p);
+  g.imbalanceTolerance={1.05};
+  g.partitionObjects();
+
+  idx_t share[2]={0,0};
+  for (auto& i: g)
+    {
+      check(i.proc()==myid(),"partitionObjects proc",i.id());
+      auto w=i->weights();
+      share[0]+=w[0];
+      share[1]+=w[1];
+    }
+  check(allReduce(share[0],ReduceOp::sum)==size*size+8,"partitionObjects total",0);
+#ifdef PARMETIS
+  /* partitioning is heuristic, so allow some slack over imbalanceTolerance */
+  double capacityShare=2.0*(myid()+1)/(nprocs()*(nprocs()+1));
+  for (int c=0; c<2; c++)
+    {
+      double total=allReduce(share[c],ReduceOp::sum);
+      check(std::fabs(share[c]/total-capacityShare)<0.25*capacityShare,"constraint share",c);
+    }
+#endif
+}
+
+/// neighbours of \a id at \a step of the halo tests, built from \a plain
+vector<GraphId> haloLinks(Graph<Cell>& plain, GraphId id, int step)
+{
+  auto r=plain.objects[id]->neighbours;
+  /* processor 0's objects grow at step 2, and shrink back after */
+  if (step==2 && plain.objects[id].proc==0)
+    r.insert(r.end(),200,r[0]);
+  return r;
+}
+
+/**
+   exchange ghosts by \a backend for a few steps, changing every
+   hosted object's value and links each step, and check that every
+   ghost then holds its host's state. The last processor hosts a
+   component of its own, so has no boundary. If \a split, hosted
+   objects are updated again between beginPrepareNeighbours and
+   endPrepareNeighbours, which must not reach the ghosts.
+*/
+void checkHalo(GraphBase::HaloBackend backend, bool split=false)
+{
+  Graph<Cell> plain, g;
+  for (auto* h: {&plain,&g})
+    {
+      build(*h);
+      unsigned others=std::max(1U,nprocs()-1);
+      for (GraphId id=0; id<ring+5; id++)
+        h->objects[id].proc=
+          id<triangle? id/size*others/size: id<ring? id%others: nprocs()-1;
+      h->rebuildPtrLists();
+    }
+  g.haloBackend=backend;
+  for (int step=1; step<=3; step++)
+    {
+      for (auto& i: g)
+        {
+          i->as<Cell>()->value=step*1000.0+i.id();
+          i->neighbours=haloLinks(plain,i.id(),step);
+        }
+      /* the request plan is unchanged, so is kept from the first step */
+      if (split)
+        {
+          g.beginPrepareNeighbours(true);
+          for (auto& i: g) i->as<Cell>()->value+=0.5;
+          g.endPrepareNeighbours();
+        }
+      else
+        g.prepareNeighbours(true);
+
+      for (auto& i: g)
+        for (auto& j: *i)
+          if (j.proc()!=myid())
+            {
+              check(myid()<nprocs()-1,"no boundary",j.id());
+              check(j->as<Cell>()->value==step*1000.0+j.id(),"ghost value",j.id());
+              check(j->neighbours==haloLinks(plain,j.id(),step),"ghost links",j.id());
+            }
+    }
+}
+
+/// the shared memory backend delivers every ghost's current state
+void testSharedHalo()
+{checkHalo(GraphBase::sharedMemory);}
+
+/**
+   the RMA backend delivers every ghost's current state, including
+   once processor 0's payload outgrows the data windows
+*/
+void testRMAHalo()
+{checkHalo(GraphBase::rma);}
+
+/**
+   the neighbourhood backend delivers every ghost's state as at
+   beginPrepareNeighbours, with work overlapping the exchange
+*/
+void testNeighbourhoodHalo()
+{
+  checkHalo(GraphBase::neighbourhood);
+  checkHalo(GraphBase::neighbourhood,true);
+}
+
+/**
+   smooth each value with its neighbours' for a few steps, exchanging
+   the halo every \a haloDepth steps, returning the final values
+*/
+std::map<GraphId,double> smooth(unsigned haloDepth)
+{
+  Graph<Cell> g;
+  build(g);
+  g.haloDepth=haloDepth;
+  for (auto& i: g.objectRefs) i->as<Cell>()->value=i.id()%7;
+  for (unsigned step=0; step<6; step++)
+    {
+      if (step%haloDepth==0)
+        g.prepareNeighbours(true);
+      std::map<GraphId,double> next;
+      g.forUpdateSet(step, [&](ObjRef& x) {
+          double sum=g.objects[x.id()]->value;
+          unsigned n=1;
+          x->forEachNeighbourId([&](GraphId j) {sum+=g.objects[j]->value; n++;});
+          next[x.id()]=sum/n;
+        });
+      for (auto& v: next)
+        g.objects[v.first]->value=v.second;
+    }
+  std::map<GraphId,double> values;
+  for (auto& i: g)
+    values[i.id()]=i->as<Cell>()->value;
+  return values;
+}
+
+/// deep halos give the same answer as exchanging every step, and depth 0 is rejected
+void testHaloDepth()
+{
+  auto shallow=smooth(1), deep=smooth(3);
+  check(shallow.size()==deep.size(),"haloDepth objects",deep.size());
+  for (auto& v: shallow)
+    check(deep[v.first]==v.second,"haloDepth",v.first);
+
+  Graph<Cell> g;
+  build(g);
+  g.haloDepth=0;
+  bool thrown=false;
+  try {g.updateRequests();}
+  catch (const std::runtime_error&) {thrown=true;}
+  check(thrown,"haloDepth 0 rejected");
+}
+
+/// total ghost bytes received by all processors so far
+double haloBytes(const Graph<Cell>& g, unsigned exchanges)
+{return g.measuredHaloVolume()*exchanges;}
+
+/**
+   the versioned exchange resends only objects touched since the last
+   exchange, and reading objects does not count as a change
+*/
+void testVersioned()
+{
+  Graph<Cell> g;
+  build(g);
+  g.haloBackend=GraphBase::versioned;
+  for (auto& i: g.objectRefs) i->as<Cell>()->value=i.id();
+  g.prepareNeighbours(true);
+  double first=haloBytes(g,1);
+
+  /* reads, through as() and reductions, send nothing */
+  double sum=0;
+  for (auto& i: g) sum+=i->as<Cell>()->value;
+  double total=g.sum([](const Cell& c) {return c.value;});
+  check(total==allReduce(sum,ReduceOp::sum),"versioned sum");
+  g.prepareNeighbours(true);
+  double second=haloBytes(g,2)-first;
+
+  /* touched objects are resent */
+  for (auto& i: g)
+    {
+      i->as<Cell>()->value=-double(i.id());
+      if (i.id()%2) i->touch();
+    }
+  g.prepareNeighbours(true);
+  double third=haloBytes(g,3)-first-second;
+  std::set<GraphId> ghosts;
+  for (auto& i: g)
+    i->forEachNeighbourId([&](GraphId n) {
+        if (g.objects[n].proc!=myid()) ghosts.insert(n);
+      });
+  for (auto id: ghosts)
+    check(g.objects[id]->value==(id%2? -double(id): id),"versioned ghost",id);
+  if (nprocs()>1)
+    {
+      check(second<0.1*first,"versioned unchanged",second);
+      check(third>second && third<first,"versioned touched",third);
+    }
+}
+
+/// forEachBlock visits every hosted object exactly once per sweep
+void testBlocks()
+{
+  Graph<Cell> g;
+  build(g);
+  size_t footprint=Graph<Cell>::footprint(*g.begin());
+  g.cacheBudget=10*footprint;
+  for (unsigned sweeps: {1,3})
+    {
+      std::map<GraphId,vector<size_t>> visits;
+      size_t calls=0;
+      g.forEachBlock([&](ObjRef& i) {visits[i.id()].push_back(calls++);},sweeps);
+      check(visits.size()==g.size(),"forEachBlock objects",visits.size());
+      for (auto& i: g)
+        {
+          auto& v=visits[i.id()];
+          check(v.size()==sweeps,"forEachBlock visits",i.id());
+          /* a block is swept repeatedly before the next, so each of
+             its objects recurs with the block's size as period */
+          for (size_t j=2; j<v.size(); j++)
+            check(v[j]-v[j-1]==v[1]-v[0],"forEachBlock block sweeps",i.id());
+        }
+    }
+  size_t blocks=g.numBlocks();
+  check(blocks>=g.size()/10 && blocks<=g.size(),"numBlocks",blocks);
+  /* blocks are rebuilt with the links */
+  g.cacheBudget=g.size()*footprint;
+  g.rebuildPtrLists();
+  check(g.numBlocks()<blocks,"numBlocks rebuilt",g.numBlocks());
+}
+
+/// links of every object, as ids
+std::map<GraphId,vector<GraphId>> linkIds(Graph<Cell>& g)
+{
+  std::map<GraphId,vector<GraphId>> r;
+  for (auto& i: g.objectRefs)
+    for (auto& n: *i)
+      r[i.id()].push_back(n.id());
+  return r;
+}
+
+/**
+   bulkUpdatePtrLists builds the same links as one lookup per link,
+   including for ids sharing all their low bits
+*/
+void testBulkLinks()
+{
+  Graph<Cell> serial, bulk;
+  bulk.bulkLinkThreshold=0;
+  for (auto g: {&serial,&bulk})
+    {
+      build(*g);
+      /* links to unknown objects are dropped */
+      g->objects[0]->neighbours.push_back(ring+100);
+      g->rebuildPtrLists();
+    }
+  auto s=linkIds(serial), b=linkIds(bulk);
+  check(s.size()==b.size(),"bulk links objects",b.size());
+  for (auto& i: s)
+    check(b[i.first]==i.second,"bulk links",i.first);
+  check(s[0].size()==4,"bulk links unknown",s[0].size());
+
+  Graph<Cell> strided;
+  strided.bulkLinkThreshold=0;
+  const GraphId n=50000;
+  for (GraphId i=0; i<n; i++)
+    {
+      ObjRef o=strided.insertObject(i<<20);
+      o.proc(i%nprocs());
+      o->neighbours={((i+1)%n)<<20, ((i+n-1)%n)<<20};
+    }
+  strided.rebuildPtrLists();
+  for (auto& i: linkIds(strided))
+    check(i.second==strided.objects[i.first]->neighbours,"bulk links strided",i.first);
+  check(linkIds(strided).size()==n,"bulk links strided objects");
+}
+
+/// the local index mirrors the links, and follows ghosts replaced by advanceActive
+void testLocalIndex()
+{
+  typedef LocalIndex::Index Index;
+  Graph<Cell> g;
+  build(g);
+  g.prepareNeighbours();
+  const LocalIndex* x=&g.localIndex();
+  check(x->hosted==g.size(),"localIndex hosted",x->hosted);
+  for (Index i=0; i<x->size(); i++)
+    {
+      auto& o=g.objects[x->ids[i]];
+      check((o.proc==myid())==(i<x->hosted),"localIndex order",x->ids[i]);
+      check(&x->cell<Cell>(i)==o.get(),"localIndex cell",x->ids[i]);
+      vector<GraphId> links;
+      for (auto j: x->neighbours(i)) links.push_back(x->ids[j]);
+      vector<GraphId> expected;
+      for (auto& n: *o) expected.push_back(n.id());
+      check(links==expected,"localIndex links",x->ids[i]);
+    }
+
+  /* a frontier-sparse exchange replaces ghosts without rebuilding the links */
+  g.denseThreshold=2;
+  g.activateAll();
+  for (auto& i: g)
+    {
+      i->as<Cell>()->value=i.id()+1;
+      g.markChanged(i.id());
+    }
+  g.advanceActive();
+  x=&g.localIndex();
+  std::set<GraphId> halo;
+  for (Index i=0; i<x->hosted; i++)
+    for (auto j: x->neighbours(i))
+      if (j>=x->hosted) halo.insert(x->ids[j]);
+  for (Index i=x->hosted; i<x->size(); i++)
+    {
+      check(&x->cell<Cell>(i)==g.objects[x->ids[i]].get(),"localIndex stale cell",x->ids[i]);
+      if (halo.count(x->ids[i]))
+        check(x->cell<Cell>(i).value==x->ids[i]+1,"localIndex stale value",x->ids[i]);
+    }
+}
+
+/// objects inserted concurrently, some more than once, are all frozen into the Graph
+void testBuilder()
+{
+  Graph<Cell> g;
+  const GraphId n=20000, existing=n/2;
+  /* objects already in the Graph are kept over those built */
+  ObjRef o=g.insertObject(existing,-1.0);
+  o.proc(0);
+  GraphBuilder<Cell> builder(g,16);
+  const unsigned nThreads=4;
+  vector<std::thread> threads;
+  for (unsigned t=0; t<nThreads; t++)
+    threads.emplace_back([&,t]() {
+        for (GraphId i=t; i<n; i+=nThreads)
+          {
+            auto& o=builder.insertObject(i,double(i));
+            o.proc=i%nprocs();
+            o->neighbours={(i+1)%n,(i+n-1)%n};
+          }
+        /* every thread also inserts a share of the others' objects */
+        for (GraphId i=0; i<n; i+=7)
+          builder.insertObject(i,double(i));
+      });
+  for (auto& t: threads) t.join();
+  builder.freeze();
+
+  check(g.objects.size()==n,"GraphBuilder objects",g.objects.size());
+  unsigned hosted=0;
+  for (auto& i: g.objectRefs)
+    {
+      if (i.id()==existing)
+        {
+          check(i->as<Cell>()->value==-1,"GraphBuilder existing",i.id());
+          continue;
+        }
+      check(i->as<Cell>()->value==i.id(),"GraphBuilder value",i.id());
+      check(i.proc()==i.id()%nprocs(),"GraphBuilder proc",i.id());
+      check(i->size()==2,"GraphBuilder links",i.id());
+      hosted+=i.proc()==myid();
+    }
+  check(g.size()==hosted+(myid()==0),"GraphBuilder hosted",g.size());
+}
+
+/// size of file \a name, or 0 if it does not exist
+long fileSize(const std::string& name)
+{
+  FILE* f=fopen(name.c_str(),"rb");
+  if (!f) return 0;
+  fseek(f,0,SEEK_END);
+  long size=ftell(f);
+  fclose(f);
+  return size;
+}
+
+std::string checkpointFile(unsigned n)
+{return "checkpoint."+std::to_string(myid())+"."+std::to_string(n);}
+
+/// hosted objects' values and links
+std::map<GraphId,std::pair<double,vector<GraphId>>> hostedState(Graph<Cell>& g)
+{
+  std::map<GraphId,std::pair<double,vector<GraphId>>> r;
+  for (auto& i: g)
+    r[i.id()]={i->as<Cell>()->value,i->neighbours};
+  return r;
+}
+
+/**
+   restoring a base checkpoint and its deltas, before and after
+   compaction, gives back the graph as checkpointed
+*/
+void testCheckpoint()
+{
+  Graph<Cell> g;
+  build(g);
+  g.compactInterval=3;
+  for (auto& i: g) i->as<Cell>()->value=i.id();
+  g.checkpoint("checkpoint");
+  long base=fileSize(checkpointFile(1));
+  check(base>0,"checkpoint base",base);
+
+  for (unsigned n=2; n<=5; n++)
+    {
+      /* one object changes value, and another its links alone */
+      auto& changed=g[n%g.size()];
+      changed->as<Cell>()->value=-double(n);
+      changed->touch();
+      g[(n+1)%g.size()]->neighbours.push_back(ring);
+      g.checkpoint("checkpoint");
+      if (n!=4) /* checkpoint 4 is a new base */
+        check(fileSize(checkpointFile(n))<base/4 || g.size()<8,"checkpoint delta",n);
+
+      auto expected=hostedState(g);
+      Graph<Cell> restored;
+      restored.restoreCheckpoint("checkpoint");
+      check(hostedState(restored)==expected,"restoreCheckpoint",n);
+      /* remote neighbours are present, hosted where they are hosted */
+      for (auto& i: restored)
+        for (auto& j: *i)
+          check(j.proc()==g.objects[j.id()].proc,"restoreCheckpoint ghost",j.id());
+    }
+  /* compaction removed the files before the latest base */
+  for (unsigned n=1; n<4; n++)
+    check(fileSize(checkpointFile(n))==0,"checkpoint compaction",n);
+  for (unsigned n=4; n<=5; n++)
+    remove(checkpointFile(n).c_str());
+  remove(("checkpoint."+std::to_string(myid())+".head").c_str());
+}
+
+/// ids linked in relation \a r from hosted objects, that are not themselves hosted
+std::set<GraphId> remoteLinks(Graph<Cell>& g, unsigned r)
+{
+  std::set<GraphId> ids;
+  for (auto& i: g)
+    i->forEachLinkId(r,[&](GraphId j) {
+        if (g.objects[j].proc!=myid()) ids.insert(j);
+      });
+  return ids;
+}
+
+/**
+   two relations have their own links and exchanges, and a relation's
+   plan is rebuilt with the neighbour plan
+*/
+void testRelations()
+{
+  Graph<Cell> g;
+  build(g);
+  unsigned far=g.addRelation("far"), diagonal=g.addRelation("diagonal");
+  check(g.addRelation("far")==far && g.relation("far")==far &&
+        g.relation("diagonal")==diagonal && g.relation("neighbours")==0,"relation numbers");
+  for (auto& i: g)
+    {
+      i->as<Cell>()->value=i.id()+1;
+      if (i.id()<triangle)
+        {
+          int x=i.id()%size, y=i.id()/size;
+          i->linkIds(far)={makeId(x+size/2,y+size/2)};
+          i->linkIds(diagonal)={makeId(x+1,y+1),makeId(x-1,y-1)};
+        }
+    }
+  g.rebuildPtrLists();
+
+  auto checkLinks=[&](unsigned r, double sign) {
+    for (size_t i=0; i<g.size(); i++)
+      {
+        vector<GraphId> ids;
+        for (auto& j: g.links(r,i))
+          {
+            ids.push_back(j.id());
+            check(j->as<Cell>()->value==sign*(j.id()+1),"relation value",j.id());
+          }
+        check(ids==g[i]->linkIds(r),"relation links",g[i].id());
+      }
+  };
+  g.prepareRelation(far);
+  checkLinks(far,1);
+  /* ghosts of the other relations are not fetched */
+  auto farIds=remoteLinks(g,far);
+  for (auto id: remoteLinks(g,diagonal))
+    if (!farIds.count(id))
+      check(g.objects[id]->value==0,"relation fetched only its ghosts",id);
+  g.prepareRelation(diagonal);
+  checkLinks(diagonal,1);
+
+  /* relinking needs a new plan, made along with the neighbour plan */
+  for (auto& i: g)
+    {
+      i->as<Cell>()->value=-double(i.id()+1);
+      if (i.id()<triangle)
+        {
+          int x=i.id()%size, y=i.id()/size;
+          i->linkIds(far)={makeId(x+size/2,y+size/2+1)};
+        }
+    }
+  g.rebuildPtrLists();
+  g.updateRequests();
+  g.prepareRelation(far);
+  checkLinks(far,-1);
+}
+
+/**
+   a hub linked to the whole torus gathers the same total as a serial
+   sum, on its master and every mirror, including after the objects
+   are repartitioned and redistributed
+*/
+void testHubs()
+{
+  Graph<Cell> g;
+  build(g);
+  const GraphId hub=ring+5;
+  ObjRef h=g.insertObject(hub);
+  h.proc(nprocs()-1);
+  for (GraphId i=0; i<triangle; i++)
+    h->neighbours.push_back(i);
+  g.rebuildPtrLists();
+  g.hubDegree=size*size/2;
+  g.setupHubs();
+  check(g.isHub(hub),"setupHubs");
+
+  auto update=[&](unsigned stage) {
+    for (auto& i: g)
+      i->as<Cell>()->value=stage*(i.id()+1.0);
+    g.updateHubs<double>
+      ([](const Cell& hub, const Cell& n) {return n.value;},
+       [](double x, double y) {return x+y;},
+       [](Cell& hub, double total) {hub.value=total;});
+    /* every processor hosts part of the torus, so holds a mirror */
+    check(g.objects[hub]->value==stage*size*size*(size*size+1)/2,"updateHubs",stage);
+  };
+  update(1);
+  g.partitionObjects();
+  update(2);
+  g.distributeObjects();
+  update(3);
+  check(g.objects[hub]->neighbours.size()==size*size || g.objects[hub].proc!=myid(),
+        "distributeObjects hub links");
+}
+
+/// counts the objects constructed from it by bulkInsert
+struct Count
+{
+  double value;
+  mutable std::atomic<unsigned> made{0};
+  operator double() const {made++; return value;}
+};
+
+/**
+   bulkInsert builds objects with their hosts and links from CSR
+   arrays, keeps objects already present without constructing
+   another, and rejects inconsistent arrays
+*/
+void testBulkInsert()
+{
+  Graph<Cell> g;
+  const GraphId n=1000, existing=n/2;
+  ObjRef o=g.insertObject(existing,-1.0);
+  o.proc(0);
+
+  vector<GraphId> ids, targets;
+  vector<unsigned> procs;
+  vector<size_t> offsets{0};
+  for (GraphId i=0; i<n; i++)
+    {
+      ids.push_back(i);
+      procs.push_back(i%nprocs());
+      /* object i links to its predecessors, up to 3 of them */
+      for (GraphId j=1; j<=std::min<GraphId>(i,3); j++)
+        targets.push_back(i-j);
+      offsets.push_back(targets.size());
+    }
+  /* a repeated id, with a link list of its own */
+  ids.push_back(1);
+  procs.push_back(0);
+  targets.push_back(n-1);
+  offsets.push_back(targets.size());
+
+  Count value{2};
+  g.bulkInsert(ids,procs,offsets,targets,value);
+  check(value.made==n-1,"bulkInsert constructions",value.made);
+  check(g.objects.size()==n,"bulkInsert objects",g.objects.size());
+  unsigned hosted=0;
+  for (auto& i: g.objectRefs)
+    {
+      if (i.id()==existing)
+        {
+          check(i->as<Cell>()->value==-1,"bulkInsert existing",i.id());
+          continue;
+        }
+      check(i->as<Cell>()->value==2,"bulkInsert value",i.id());
+      check(i.proc()==i.id()%nprocs(),"bulkInsert proc",i.id());
+      auto& nbrs=i->as<Cell>()->neighbours;
+      check(nbrs.size()==std::min<GraphId>(i.id(),3),"bulkInsert links",i.id());
+      for (size_t j=0; j<nbrs.size(); j++)
+        check(nbrs[j]==i.id()-j-1,"bulkInsert link order",i.id());
+      hosted+=i.proc()==myid();
+    }
+  check(g.size()==hosted+(myid()==0),"bulkInsert hosted",g.size());
+
+  auto rejected=[&](const vector<GraphId>& ids, const vector<size_t>& offsets) {
+    Graph<Cell> h;
+    vector<unsigned> procs(ids.size());
+    try {h.bulkInsert(ids,procs,offsets,targets);}
+    catch (const std::runtime_error&) {return h.objects.empty();}
+    return false;
+  };
+  check(rejected({0,1},{0,1}),"bulkInsert offsets size");
+  check(rejected({0,1},{0,1,targets.size()+1}),"bulkInsert offsets past targets");
+  check(rejected({0,1,2},{0,2,1,3}),"bulkInsert decreasing offsets");
+}
+
+/**
+   memoryUsage accounts for the hosted objects and their ghosts,
+   memoryUsageByRank gathers every processor's, and phase peaks are
+   only sampled while trackMemoryPhases is set
+*/
+void testMemory()
+{
+  Graph<Cell> g;
+  build(g);
+  g.prepareNeighbours();
+  check(g.memoryUsage().phasePeak.empty(),"memory phases untracked");
+  g.trackMemoryPhases=true;
+  g.prepareNeighbours();
+  g.trackMemoryPhases=false;
+  g.distributeObjects();
+
+  vector<size_t> hosted(nprocs());
+  for (GraphId id=0; id<ring+5; id++)
+    hosted[g.objects[id].proc]++;
+  auto m=g.memoryUsage();
+  check(m.hosted==hosted[myid()]*sizeof(Cell),"memoryUsage hosted",m.hosted);
+  check(m.ghosts==(ring+5-hosted[myid()])*sizeof(Cell),"memoryUsage ghosts",m.ghosts);
+  check(m.neighbours>=(ring+5)*2*sizeof(GraphId),"memoryUsage neighbours",m.neighbours);
+  check(m.total()>m.hosted+m.ghosts+m.neighbours,"memoryUsage total",m.total());
+  check(m.peakResident>=m.resident,"memoryUsage peakResident",m.peakResident);
+  check(m.phasePeak.size()==1 && m.phasePeak.count("halo"),"memoryUsage phases",m.phasePeak.size());
+#ifdef __linux__
+  check(m.resident>0,"memoryUsage resident");
+  check(m.phasePeak["halo"]>0,"memoryUsage halo peak");
+#endif
+
+  auto byRank=g.memoryUsageByRank();
+  check(byRank.size()==nprocs(),"memoryUsageByRank size",byRank.size());
+  for (unsigned p=0; p<byRank.size(); p++)
+    {
+      check(byRank[p].hosted==hosted[p]*sizeof(Cell),"memoryUsageByRank hosted",p);
+      check(byRank[p].phasePeak.count("halo"),"memoryUsageByRank phases",p);
+    }
+  check(byRank[myid()].entries==m.entries && byRank[myid()].plan==m.plan,
+        "memoryUsageByRank own",myid());
+}
+
+/**
+   CompressedIds decodes to the sorted ids, including deltas of 2^63
+   and more, and repeated ids, and neighbours appended after
+   compression are kept and merged by the next compression
+*/
+void testCompressedIds()
+{
+  const GraphId big=GraphId(1)<<63;
+  for (vector<GraphId> ids: {vector<GraphId>{},
+        {big,0,big+1,~GraphId(0),big-1,1},
+        {5,7,5,5,0,7},
+        {GraphId(0x7f),0x80,0x3fff,0x4000,~GraphId(0)-1,~GraphId(0)}})
+    {
+      CompressedIds c(ids);
+      std::sort(ids.begin(),ids.end());
+      check(c.decode()==ids,"CompressedIds round trip",ids.size());
+      check(c.size()==ids.size(),"CompressedIds size",c.size());
+    }
+
+  Cell c;
+  c.neighbours={9,3,big};
+  c.compressNeighbours();
+  check(c.neighbours.empty() && c.neighbourCount()==3,"compressNeighbours");
+  c.neighbours={1,3};
+  vector<GraphId> ids;
+  c.forEachNeighbourId([&](GraphId n) {ids.push_back(n);});
+  check(ids==vector<GraphId>{3,9,big,1,3},"forEachNeighbourId mixed",ids.size());
+  c.compressNeighbours();
+  check(c.compressedNeighbours.decode()==vector<GraphId>{1,3,3,9,big},"compressNeighbours merge");
+  c.neighbours={0};
+  c.expandNeighbours();
+  check(c.compressedNeighbours.empty() && c.neighbours==vector<GraphId>{1,3,3,9,big,0},
+        "expandNeighbours");
+}
+
+/**
+   a compressed graph keeps its neighbours, and its links in id order,
+   when distributed from processor 0, in ghost exchanges, and after
+   partitioning migrates objects, and is expanded again on request
+*/
+void testCompressed()
+{
+  Graph<Cell> plain, g;
+  build(plain);
+  g.compressedAdjacency=true;
+  if (myid()==0) build(g);
+  g.distributeObjects();
+
+  auto checkLinks=[&](const char* msg) {
+    for (auto& i: g.objectRefs)
+      {
+        if (!i) continue;
+        vector<GraphId> expected=plain.objects[i.id()]->neighbours;
+        std::sort(expected.begin(),expected.end());
+        check(i->neighbours.empty() && i->compressedNeighbours.decode()==expected,msg,i.id());
+      }
+    for (auto& i: g)
+      {
+        vector<GraphId> links;
+        for (auto& j: *i)
+          {
+            links.push_back(j.id());
+            check(j->as<Cell>()->value==j.id()+1.0,msg,j.id());
+          }
+        vector<GraphId> expected;
+        i->forEachNeighbourId([&](GraphId n) {expected.push_back(n);});
+        check(links==expected,msg,i.id());
+      }
+  };
+  for (auto& i: g) i->as<Cell>()->value=i.id()+1.0;
+  g.prepareNeighbours();
+  checkLinks("compressed distributeObjects");
+
+  g.partitionObjects();
+  for (auto& i: g) i->as<Cell>()->value=i.id()+1.0;
+  g.prepareNeighbours();
+  checkLinks("compressed partitionObjects");
+
+  g.compressedAdjacency=false;
+  g.rebuildPtrLists();
+  for (auto& i: g.objectRefs)
+    {
+      if (!i) continue;
+      vector<GraphId> expected=plain.objects[i.id()]->neighbours;
+      std::sort(expected.begin(),expected.end());
+      check(i->compressedNeighbours.empty() && i->neighbours==expected,"expanded",i.id());
+    }
+}
+
+/**
+   messages sent by every thread of every processor to the same
+   target arrive combined, one per sending processor, including those
+   of threads beyond the number available when Messages was made
+*/
+void testMessages()
+{
+  Graph<Cell> g;
+  build(g);
+  vector<GraphId> hosted;
+  for (auto& i: g) hosted.push_back(i.id());
+  Messages<double> count(g), sum(g);
+  int team=1;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(omp_get_max_threads()+2)
+#endif
+  for (size_t i=0; i<hosted.size(); i++)
+    {
+#ifdef _OPENMP
+      if (i==0) team=omp_get_num_threads();
+#endif
+      count.send(0,1);
+      for (auto n: g.objects[hosted[i]]->neighbours)
+        sum.send(n,hosted[i]+1.0);
+    }
+  count.deliver();
+  sum.deliver();
+#ifdef _OPENMP
+  check(team>omp_get_max_threads(),"Messages threads",team);
+#endif
+
+  /* all objects exist on all processors, so each one's host is known */
+  vector<double> perProc(nprocs());
+  for (GraphId id=0; id<ring+5; id++)
+    perProc[g.objects[id].proc]++;
+  if (g.objects[0].proc==myid())
+    {
+      auto received=count[0];
+      std::sort(received.begin(),received.end());
+      std::sort(perProc.begin(),perProc.end());
+      check(received==perProc,"Messages one per sending processor",received.size());
+    }
+  for (auto id: hosted)
+    {
+      std::set<unsigned> senders;
+      double expected=0;
+      for (auto n: g.objects[id]->neighbours)
+        {
+          senders.insert(g.objects[n].proc);
+          expected+=n+1.0;
+        }
+      auto& received=sum[id];
+      check(received.size()==senders.size(),"Messages combined",id);
+      double total=0;
+      for (auto m: received) total+=m;
+      check(total==expected,"Messages sum",id);
+    }
+  check(sum[ring+5].empty(),"Messages unknown id");
+  bool thrown=false;
+  try {sum.send(ring+5,1);}
+  catch (const std::runtime_error&) {thrown=true;}
+  check(thrown,"Messages send to unknown id");
+}
+
+struct Test
+{
+  const char* name;
+  void (*run)();
+};
+
+Test tests[]={
+  {"async",testAsync},
+  {"active",testActive},
+  {"histogram",testHistogram},
+  {"weights",testWeights},
+  {"sharedHalo",testSharedHalo},
+  {"rmaHalo",testRMAHalo},
+  {"neighbourhoodHalo",testNeighbourhoodHalo},
+  {"haloDepth",testHaloDepth},
+  {"versioned",testVersioned},
+  {"blocks",testBlocks},
+  {"bulkLinks",testBulkLinks},
+  {"localIndex",testLocalIndex},
+  {"builder",testBuilder},
+  {"bulkInsert",testBulkInsert},
+  {"checkpoint",testCheckpoint},
+  {"relations",testRelations},
+  {"hubs",testHubs},
+  {"memory",testMemory},
+  {"messages",testMessages},
+  {"compressedIds",testCompressedIds},
+  {"compressed",testCompressed},
+};
+
+int main(int argc, char** argv)
+{
+#ifdef MPI_SUPPORT
+  MPISPMD c(argc,argv);
+#endif
+  if (argc<2)
+    {
+      printf("usage: %s test\n",argv[0]);
+      return 1;
+    }
+  for (auto& t: tests)
+    if (strcmp(t.name,argv[1])==0)
+      {
+        t.run();
+        return failures>0;
+      }
+  fprintf(stderr,"unknown test %s\n",argv[1]);
+  return 1;
+}
@@ -0,0 +1,23 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/* per object state of the graph tests */
+struct Cell: graphcode::Object<Cell>
+{
+  double value;
+  Cell(): value(0) {}
+  Cell(double v): value(v) {}
+};
+
+/* objects with two partitioning constraints: unit work, and memory */
+struct Weighted: graphcode::Object<Weighted>
+{
+  idx_t memory;
+  Weighted(): memory(1) {}
+  vector<idx_t> weights() const override {return {1,memory};}
+};
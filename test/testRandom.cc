@@ -0,0 +1,63 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/*
+  check the counter based generator against the Random123 known
+  answers, and that the scalar and batch interfaces agree
+*/
+
+#ifdef MPI_SUPPORT
+#include <mpi.h>
+#endif
+#include "../random.h"
+#include <classdesc_epilogue.h>
+#include <stdio.h>
+using namespace graphcode;
+
+int failures=0;
+
+void check(bool cond, const char* msg)
+{
+  if (!cond)
+    {
+      fprintf(stderr,"%s failed\n",msg);
+      failures++;
+    }
+}
+
+int main()
+{
+  typedef Philox4x32::Counter C;
+  check(Philox4x32::generate({0,0,0,0},{0,0})==
+        C{0x6627e8d5,0xe169c58d,0xbc57ac4c,0x9b00dbd8},"known answer 0");
+  check(Philox4x32::generate({~0U,~0U,~0U,~0U},{~0U,~0U})==
+        C{0x408f276d,0x41c83b0e,0xa20bc7c6,0x6d5451fd},"known answer 1");
+
+  const size_t n=1001;
+  vector<GraphId> ids(n);
+  vector<double> batch(n), filled(n);
+  for (size_t i=0; i<n; ++i) ids[i]=i*7919;
+  uniformBatch(ids.data(),n,batch.data(),5,42);
+
+  double sum=0;
+  for (size_t i=0; i<n; ++i)
+    {
+      check(RandomStream(ids[i],5,42).uniform()==batch[i],"uniformBatch");
+      check(batch[i]>=0 && batch[i]<1,"range");
+      sum+=batch[i];
+    }
+  check(std::fabs(sum/n-0.5)<0.05,"mean");
+
+  RandomStream a(3,1), b(3,1);
+  a.fillUniform(filled.data(),n);
+  for (size_t i=0; i<n; ++i)
+    check(filled[i]==b.uniform(),"fillUniform");
+  check(RandomStream(3,1).uniform()!=RandomStream(3,2).uniform(),"step");
+  check(RandomStream(3,1).uniform()!=RandomStream(4,1).uniform(),"id");
+  return failures>0;
+}
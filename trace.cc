@@ -0,0 +1,113 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of EcoLab
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+#include "graphcode.h"
+#include <cstdio>
+#include <stdexcept>
+#include "classdesc_epilogue.h"
+#ifdef ECOLAB_LIB
+#include "ecolab_epilogue.h"
+#endif
+
+/*
+  Trace files are text, one record per line:
+  - "p <processor> <nprocs>" heads the file
+  - "g" starts a listing of the hosted objects, repeated after each
+    partitionObjects, followed by a line per object:
+    "o <id> <weight> <bytes> <number of neighbours> <neighbour ids...>"
+  - "x <kind> <compute> <exchange> <number of messages> <source> <bytes>..."
+    records an exchange: the seconds of computation since the end of
+    the previous exchange, the seconds spent in this one, and the
+    messages received. With split phase exchanges, computation between
+    beginPrepareNeighbours and endPrepareNeighbours counts as exchange.
+*/
+
+namespace graphcode
+{
+  struct GraphBase::TraceState
+  {
+    typedef std::chrono::steady_clock Clock;
+    FILE* f;
+    Clock::time_point lastEnd=Clock::now(), start;
+    const char* kind="";
+    double compute=0;
+    unsigned depth=0;
+    vector<std::pair<unsigned,size_t> > messages;
+    TraceState(const std::string& name): f(fopen(name.c_str(),"w"))
+    {if (!f) throw std::runtime_error("cannot open "+name);}
+    ~TraceState() {fclose(f);}
+    TraceState(const TraceState&)=delete;
+    void operator=(const TraceState&)=delete;
+  };
+
+  namespace
+  {
+    void listObjects(GraphBase& g, FILE* f)
+    {
+      fprintf(f,"g\n");
+      for (auto& i: g)
+        {
+          pack_t b;
+          b << g.objectRef(i.id());
+          fprintf(f,"o %lu %d %lu %lu",i.id(),int(i->weight()),
+                  (unsigned long)b.size(),(unsigned long)i->neighbourCount());
+          i->forEachNeighbourId([&](GraphId n) {fprintf(f," %lu",n);});
+          fprintf(f,"\n");
+        }
+    }
+  }
+
+  void GraphBase::startTrace(const std::string& prefix)
+  {
+    traceState.reset(new TraceState(prefix+"."+std::to_string(myid())+".trace"));
+    fprintf(traceState->f,"p %u %u\n",myid(),nprocs());
+    listObjects(*this,traceState->f);
+    traceState->lastEnd=TraceState::Clock::now();
+  }
+
+  void GraphBase::stopTrace()
+  {
+    traceState.reset();
+  }
+
+  void GraphBase::traceExchangeBegin(const char* kind)
+  {
+    memoryPhaseBegin(kind);
+    if (!traceState) return;
+    auto& t=*traceState;
+    if (t.depth++) return;
+    t.start=TraceState::Clock::now();
+    t.compute=std::chrono::duration<double>(t.start-t.lastEnd).count();
+    t.kind=kind;
+    t.messages.clear();
+  }
+
+  void GraphBase::traceExchangeEnd()
+  {
+    memoryPhaseEnd();
+    if (!traceState) return;
+    auto& t=*traceState;
+    if (--t.depth) return;
+    auto end=TraceState::Clock::now();
+    fprintf(t.f,"x %s %g %g %lu",t.kind,t.compute,
+            std::chrono::duration<double>(end-t.start).count(),(unsigned long)t.messages.size());
+    for (auto& m: t.messages)
+      fprintf(t.f," %u %lu",m.first,(unsigned long)m.second);
+    fprintf(t.f,"\n");
+    /* objects have moved */
+    if (std::string(t.kind)=="partition")
+      listObjects(*this,t.f);
+    t.lastEnd=TraceState::Clock::now();
+  }
+
+  void GraphBase::traceMessage(unsigned proc, size_t bytes)
+  {
+    if (traceState && traceState->depth)
+      traceState->messages.emplace_back(proc,bytes);
+  }
+}
@@ -0,0 +1,395 @@
+/*
+  @copyright Russell Standish 2000-2013
+  @author Russell Standish
+  This file is part of Graphcode
+
+  Open source licensed under the MIT license. See LICENSE for details.
+*/
+
+/*
+  Offline scaling predictor for traces recorded by GraphBase::startTrace.
+
+  usage: trace_predict [-latency s] [-bandwidth bytes/s] [-partition block|hash|bfs|recorded]
+                       prefix [ranks...]
+
+  The computation cost per unit of object weight is calibrated from
+  the trace. Each step on each processor is then modelled as the
+  computation of its hosted objects, plus one message to and from
+  each neighbouring processor, costing latency + bytes/bandwidth,
+  where the bytes are the serialised sizes of the ghosts
+  exchanged. A step takes as long as its slowest (critical) processor.
+
+  Strong scaling partitions the traced graph over each number of
+  ranks. Weak scaling replicates the graph once per traced processor
+  count, so only rank counts that are multiples of it are predicted.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <deque>
+#include <stdint.h>
+
+using namespace std;
+
+typedef unsigned long Id;
+
+struct Object
+{
+  double weight=1, bytes=0;
+  unsigned owner=0;
+  vector<Id> neighbours;
+};
+
+/// measured totals over the steps of one processor
+struct Measured
+{
+  double compute=0, exchange=0;
+  unsigned steps=0;
+  unsigned long messages=0, bytes=0;
+};
+
+struct Trace
+{
+  unsigned nprocs=0;
+  map<Id,Object> objects;
+  vector<Measured> measured;
+
+  bool read(const string& prefix)
+  {
+    for (unsigned proc=0; proc==0 || proc<nprocs; proc++)
+      {
+        string name=prefix+"."+to_string(proc)+".trace";
+        ifstream f(name);
+        if (!f)
+          {
+            fprintf(stderr,"cannot open %s\n",name.c_str());
+            return false;
+          }
+        /* only the last listing of objects applies, along with the steps after it */
+        vector<pair<Id,Object> > listing;
+        Measured m;
+        string line;
+        while (getline(f,line))
+          {
+            istringstream is(line);
+            string kind;
+            is>>kind;
+            if (kind=="p")
+              {
+                unsigned me, n;
+                is>>me>>n;
+                if (proc==0) nprocs=n;
+                measured.resize(nprocs);
+              }
+            else if (kind=="g")
+              {
+                listing.clear();
+                m=Measured();
+              }
+            else if (kind=="o")
+              {
+                Id id; size_t n;
+                Object o;
+                is>>id>>o.weight>>o.bytes>>n;
+                o.owner=proc;
+                o.neighbours.resize(n);
+                for (auto& i: o.neighbours) is>>i;
+                listing.emplace_back(id,o);
+              }
+            else if (kind=="x")
+              {
+                string what;
+                double compute, exchange;
+                unsigned long n;
+                is>>what>>compute>>exchange>>n;
+                if (what=="partition") continue;
+                m.steps++;
+                m.compute+=compute;
+                m.exchange+=exchange;
+                m.messages+=n;
+                for (unsigned long i=0; i<n; i++)
+                  {
+                    unsigned source; unsigned long bytes;
+                    is>>source>>bytes;
+                    m.bytes+=bytes;
+                  }
+              }
+          }
+        for (auto& o: listing)
+          objects[o.first]=o.second;
+        measured[proc]=m;
+      }
+    return true;
+  }
+};
+
+/// the traced graph in compressed form, indexed by position in id order
+struct Graph
+{
+  vector<Id> ids;
+  vector<double> weight, bytes;
+  vector<unsigned> recordedOwner;
+  vector<size_t> offsets{0};
+  vector<size_t> links;
+
+  Graph(const Trace& t)
+  {
+    unordered_map<Id,size_t> index;
+    for (auto& o: t.objects)
+      {
+        index[o.first]=ids.size();
+        ids.push_back(o.first);
+        weight.push_back(o.second.weight);
+        bytes.push_back(o.second.bytes);
+        recordedOwner.push_back(o.second.owner);
+      }
+    for (auto& o: t.objects)
+      {
+        for (auto n: o.second.neighbours)
+          {
+            auto i=index.find(n);
+            if (i!=index.end() && n!=o.first) links.push_back(i->second);
+          }
+        offsets.push_back(links.size());
+      }
+  }
+  size_t size() const {return ids.size();}
+  double totalWeight() const {
+    double w=0;
+    for (auto x: weight) w+=x;
+    return w;
+  }
+};
+
+struct Model
+{
+  double latency=2e-6, bandwidth=1e9, costPerWeight=0;
+};
+
+struct Prediction
+{
+  double step=0, compute=0, comm=0;
+  unsigned critical=0;
+};
+
+/**
+   owner of each object of \a copies replicas of \a g, replica c
+   occupying positions [c*g.size(), (c+1)*g.size())
+*/
+vector<unsigned> partition(const Graph& g, unsigned copies, unsigned ranks, const string& scheme)
+{
+  size_t n=g.size(), total=n*copies;
+  vector<unsigned> owner(total);
+  if (scheme=="hash")
+    {
+      Id stride=g.ids.empty()? 1: g.ids.back()+1;
+      for (size_t i=0; i<total; i++)
+        owner[i]=(g.ids[i%n]+stride*(i/n))%ranks;
+      return owner;
+    }
+  if (scheme=="recorded")
+    {
+      unsigned traced=*max_element(g.recordedOwner.begin(),g.recordedOwner.end())+1;
+      for (size_t i=0; i<total; i++)
+        owner[i]=g.recordedOwner[i%n]+traced*(i/n);
+      return owner;
+    }
+
+  /* block and bfs: cut an ordering of one replica into pieces of equal weight */
+  vector<size_t> order;
+  if (scheme=="bfs")
+    {
+      /* links are followed in both directions */
+      vector<vector<size_t> > adj(n);
+      for (size_t i=0; i<n; i++)
+        for (size_t j=g.offsets[i]; j<g.offsets[i+1]; j++)
+          {
+            adj[i].push_back(g.links[j]);
+            adj[g.links[j]].push_back(i);
+          }
+      vector<bool> seen(n);
+      for (size_t s=0; s<n; s++)
+        {
+          if (seen[s]) continue;
+          deque<size_t> queue{s};
+          seen[s]=true;
+          while (!queue.empty())
+            {
+              size_t i=queue.front();
+              queue.pop_front();
+              order.push_back(i);
+              for (auto j: adj[i])
+                if (!seen[j])
+                  {
+                    seen[j]=true;
+                    queue.push_back(j);
+                  }
+            }
+        }
+    }
+  else
+    for (size_t i=0; i<n; i++) order.push_back(i);
+
+  double w=g.totalWeight()*copies, sum=0;
+  for (unsigned c=0; c<copies; c++)
+    for (auto i: order)
+      {
+        owner[c*n+i]=min<unsigned>(ranks-1,(sum+0.5*g.weight[i])*ranks/w);
+        sum+=g.weight[i];
+      }
+  return owner;
+}
+
+Prediction predict(const Graph& g, unsigned copies, unsigned ranks,
+                   const vector<unsigned>& owner, const Model& model)
+{
+  size_t n=g.size();
+  vector<double> compute(ranks), bytes(ranks);
+  vector<unsigned long> messages(ranks);
+  /* each ghost needed: (processor, object) */
+  vector<pair<unsigned,size_t> > ghosts;
+  for (size_t i=0; i<n*copies; i++)
+    {
+      size_t base=i/n*n, local=i%n;
+      unsigned r=owner[i];
+      compute[r]+=g.weight[local]*model.costPerWeight;
+      for (size_t j=g.offsets[local]; j<g.offsets[local+1]; j++)
+        {
+          size_t k=base+g.links[j];
+          if (owner[k]!=r) ghosts.emplace_back(r,k);
+        }
+    }
+  sort(ghosts.begin(),ghosts.end());
+  ghosts.erase(unique(ghosts.begin(),ghosts.end()),ghosts.end());
+
+  vector<pair<unsigned,unsigned> > peers;
+  for (auto& x: ghosts)
+    {
+      unsigned q=owner[x.second];
+      double b=g.bytes[x.second%n];
+      bytes[x.first]+=b;
+      bytes[q]+=b;
+      peers.emplace_back(x.first,q);
+    }
+  sort(peers.begin(),peers.end());
+  peers.erase(unique(peers.begin(),peers.end()),peers.end());
+  for (auto& p: peers)
+    {
+      messages[p.first]++;
+      messages[p.second]++;
+    }
+
+  Prediction r;
+  for (unsigned p=0; p<ranks; p++)
+    {
+      double comm=messages[p]*model.latency+bytes[p]/model.bandwidth;
+      if (compute[p]+comm>r.step)
+        {
+          r.step=compute[p]+comm;
+          r.compute=compute[p];
+          r.comm=comm;
+          r.critical=p;
+        }
+    }
+  return r;
+}
+
+int main(int argc, char** argv)
+{
+  Model model;
+  string scheme="block";
+  int arg=1;
+  for (; arg<argc-1 && argv[arg][0]=='-'; arg+=2)
+    {
+      if (strcmp(argv[arg],"-latency")==0)
+        model.latency=atof(argv[arg+1]);
+      else if (strcmp(argv[arg],"-bandwidth")==0)
+        model.bandwidth=atof(argv[arg+1]);
+      else if (strcmp(argv[arg],"-partition")==0)
+        scheme=argv[arg+1];
+      else
+        break;
+    }
+  if (arg>=argc || (scheme!="block" && scheme!="hash" && scheme!="bfs" && scheme!="recorded"))
+    {
+      fprintf(stderr,"usage: %s [-latency s] [-bandwidth bytes/s] "
+              "[-partition block|hash|bfs|recorded] prefix [ranks...]\n",argv[0]);
+      return 1;
+    }
+
+  Trace trace;
+  if (!trace.read(argv[arg])) return 1;
+  Graph g(trace);
+  vector<unsigned> rankCounts;
+  for (arg++; arg<argc; arg++)
+    rankCounts.push_back(atoi(argv[arg]));
+  if (rankCounts.empty())
+    for (unsigned p=1; p<=64; p*=2) rankCounts.push_back(p);
+
+  /* calibrate the cost of computation from the mean step on each processor */
+  double measuredCompute=0;
+  Prediction measured;
+  unsigned steps=0;
+  for (unsigned p=0; p<trace.nprocs; p++)
+    {
+      auto& m=trace.measured[p];
+      if (m.steps==0) continue;
+      steps=max(steps,m.steps);
+      measuredCompute+=m.compute/m.steps;
+      double step=(m.compute+m.exchange)/m.steps;
+      if (step>measured.step)
+        {
+          measured.step=step;
+          measured.critical=p;
+        }
+    }
+  if (steps==0 || g.size()==0)
+    {
+      fprintf(stderr,"no steps or objects recorded\n");
+      return 1;
+    }
+  model.costPerWeight=measuredCompute/g.totalWeight();
+
+  printf("trace: %u processors, %u steps, %zu objects, %zu links\n",
+         trace.nprocs,steps,g.size(),g.links.size());
+  printf("compute %g s per unit weight, latency %g s, bandwidth %g bytes/s\n",
+         model.costPerWeight,model.latency,model.bandwidth);
+  auto recorded=predict(g,1,trace.nprocs,partition(g,1,trace.nprocs,"recorded"),model);
+  printf("traced partition: measured %g s/step (critical processor %u), "
+         "modelled %g s/step (critical processor %u)\n",
+         measured.step,measured.critical,recorded.step,recorded.critical);
+
+  double serial=g.totalWeight()*model.costPerWeight;
+  printf("\nstrong scaling, %s partition\n",scheme.c_str());
+  printf("%8s %12s %10s %10s %8s %9s\n","ranks","step(s)","speedup","efficiency","comm%","critical");
+  for (auto p: rankCounts)
+    {
+      if (scheme=="recorded" && p!=trace.nprocs) continue;
+      auto r=predict(g,1,p,partition(g,1,p,scheme),model);
+      printf("%8u %12.4g %10.3f %10.3f %8.1f %9u\n",p,r.step,serial/r.step,
+             serial/(p*r.step),100*r.comm/r.step,r.critical);
+    }
+
+  Prediction base;
+  printf("\nweak scaling, %s partition, %zu objects per %u ranks\n",
+         scheme.c_str(),g.size(),trace.nprocs);
+  printf("%8s %12s %10s %8s %9s\n","ranks","step(s)","efficiency","comm%","critical");
+  for (auto p: rankCounts)
+    {
+      if (p%trace.nprocs) continue;
+      unsigned copies=p/trace.nprocs;
+      auto r=predict(g,copies,p,partition(g,copies,p,scheme),model);
+      if (base.step==0) base=r;
+      printf("%8u %12.4g %10.3f %8.1f %9u\n",p,r.step,base.step/r.step,
+             100*r.comm/r.step,r.critical);
+    }
+  return 0;
+}